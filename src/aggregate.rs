@@ -0,0 +1,256 @@
+//! Summary statistics of number files.
+//!
+//! [`aggregate`] parses every whitespace-separated token with the rules of
+//! [`convert_base`](crate::convert_base) and folds the values into a count, minimum, maximum,
+//! exact sum and a histogram of their bit widths. Nothing is formatted until the end, so the
+//! run costs little more than parsing. Large inputs are split across threads, each with its
+//! own accumulator, and the accumulators are merged once all threads are done.
+use crate::input::{map_parts, tokens};
+use crate::{BigUint, ConversionPlan, TokenError};
+use std::io::{self, Write};
+
+/// Configuration for an aggregation run.
+pub struct AggregateConfig {
+    /// How to parse the input and format the results.
+    pub plan: ConversionPlan,
+    /// The number of worker threads (0 to use all available cores).
+    pub threads: usize,
+}
+
+impl AggregateConfig {
+    pub fn new(plan: ConversionPlan, threads: usize) -> AggregateConfig {
+        AggregateConfig { plan, threads }
+    }
+}
+
+/// The statistics of the valid numbers of an input.
+#[derive(Debug, Clone, PartialEq)]
+pub struct Aggregate {
+    /// The number of valid tokens.
+    pub count: u64,
+    /// The number of tokens that failed to parse.
+    pub invalid: u64,
+    /// The smallest value, if there were any.
+    pub min: Option<u128>,
+    /// The largest value, if there were any.
+    pub max: Option<u128>,
+    /// The sum of the values modulo 2^128.
+    sum_low: u128,
+    /// The number of times the sum wrapped around 2^128.
+    sum_high: u64,
+    /// The number of values of each bit width, where zero has width 0.
+    pub widths: [u64; 129],
+}
+
+impl Default for Aggregate {
+    fn default() -> Aggregate {
+        Aggregate {
+            count: 0,
+            invalid: 0,
+            min: None,
+            max: None,
+            sum_low: 0,
+            sum_high: 0,
+            widths: [0; 129],
+        }
+    }
+}
+
+impl Aggregate {
+    /// Adds a value.
+    #[inline]
+    fn add(&mut self, value: u128) {
+        self.count += 1;
+        self.min = Some(self.min.map_or(value, |min| min.min(value)));
+        self.max = Some(self.max.map_or(value, |max| max.max(value)));
+        let (sum, carry) = self.sum_low.overflowing_add(value);
+        self.sum_low = sum;
+        self.sum_high += carry as u64;
+        self.widths[(u128::BITS - value.leading_zeros()) as usize] += 1;
+    }
+
+    /// Adds the statistics of another part of the input.
+    fn merge(&mut self, other: &Aggregate) {
+        self.count += other.count;
+        self.invalid += other.invalid;
+        self.min = self.min.into_iter().chain(other.min).min();
+        self.max = self.max.into_iter().chain(other.max).max();
+        let (sum, carry) = self.sum_low.overflowing_add(other.sum_low);
+        self.sum_low = sum;
+        self.sum_high += other.sum_high + carry as u64;
+        for (width, count) in self.widths.iter_mut().zip(&other.widths) {
+            *width += count;
+        }
+    }
+
+    /// Returns the exact sum of the values.
+    pub fn sum(&self) -> BigUint {
+        let limbs = [
+            self.sum_low as u64,
+            (self.sum_low >> 64) as u64,
+            self.sum_high,
+        ];
+        BigUint::from_limbs(
+            limbs
+                .iter()
+                .flat_map(|&limb| [limb as u32, (limb >> 32) as u32])
+                .collect(),
+        )
+    }
+
+    /// Writes the statistics, one per line, with the values in the target base and layout
+    /// of `plan`.
+    ///
+    /// # Arguments
+    /// * `plan` - How to format the minimum, maximum and sum.
+    /// * `out` - Receives the text.
+    pub fn write_to(&self, plan: &ConversionPlan, out: &mut dyn Write) -> io::Result<()> {
+        let format = |value: u128| {
+            let mut text = Vec::new();
+            plan.format_into(value, &mut text);
+            String::from_utf8(text).expect("digits are ASCII")
+        };
+        writeln!(out, "count: {}", self.count)?;
+        writeln!(out, "invalid: {}", self.invalid)?;
+        if let (Some(min), Some(max)) = (self.min, self.max) {
+            writeln!(out, "min: {}", format(min))?;
+            writeln!(out, "max: {}", format(max))?;
+        }
+        let mut sum = Vec::new();
+        plan.layout(&self.sum().to_digits(plan.tgt_base), &mut sum);
+        writeln!(
+            out,
+            "sum: {}",
+            String::from_utf8(sum).expect("digits are ASCII")
+        )?;
+        for (width, &count) in self.widths.iter().enumerate() {
+            if count != 0 {
+                writeln!(out, "bits {}: {}", width, count)?;
+            }
+        }
+        Ok(())
+    }
+}
+
+/// Aggregates the tokens of `data`, which starts at input offset `base_offset`.
+fn aggregate_range(
+    data: &[u8],
+    base_offset: usize,
+    plan: &ConversionPlan,
+) -> (Aggregate, Vec<TokenError>) {
+    let mut aggregate = Aggregate::default();
+    let mut errors = Vec::new();
+    for (offset, token) in tokens(data) {
+        match plan.parse_bytes(token) {
+            Ok(value) => aggregate.add(value),
+            Err(error) => errors.push(TokenError {
+                offset: base_offset + offset,
+                error,
+            }),
+        }
+    }
+    aggregate.invalid = errors.len() as u64;
+    (aggregate, errors)
+}
+
+/// Computes the count, minimum, maximum, sum and bit-width histogram of the
+/// whitespace-separated numbers of `data`.
+///
+/// # Arguments
+/// * `data` - The input, typically a memory-mapped file.
+/// * `config` - The number system of the input and the degree of parallelism.
+/// * `on_error` - Called for every token that failed to parse, in input order. Such tokens are
+///   left out of the statistics.
+///
+/// # Returns
+/// The statistics of the valid numbers.
+///
+/// # Examples
+///
+/// ```
+/// use nconv::{aggregate, AggregateConfig, ConversionPlan, NumSystem, Separators};
+///
+/// let plan = ConversionPlan::new(NumSystem::Hex, NumSystem::Dec, 0, 1, Separators::none());
+/// let config = AggregateConfig::new(plan, 1);
+/// let stats = aggregate(b"0x10 F 0xZ 0", &config, &mut |_| ());
+/// assert_eq!((stats.count, stats.invalid), (3, 1));
+/// assert_eq!((stats.min, stats.max), (Some(0), Some(16)));
+/// assert_eq!(stats.sum().to_digits(NumSystem::Dec), b"31");
+/// assert_eq!((stats.widths[0], stats.widths[4], stats.widths[5]), (1, 1, 1));
+/// ```
+pub fn aggregate(
+    data: &[u8],
+    config: &AggregateConfig,
+    on_error: &mut dyn FnMut(TokenError),
+) -> Aggregate {
+    let threads = crate::worker_threads(config.threads);
+    let plan = &config.plan;
+    let parts = map_parts(data, threads, |part, offset| {
+        aggregate_range(part, offset, plan)
+    });
+
+    let mut aggregate = Aggregate::default();
+    for (part, errors) in parts {
+        aggregate.merge(&part);
+        errors.into_iter().for_each(&mut *on_error);
+    }
+    aggregate
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::input::PARALLEL_MIN_BYTES;
+    use crate::testing::XorShift;
+    use crate::{NumSystem, Separators};
+
+    #[test]
+    fn aggregates_are_exact_on_any_number_of_threads() {
+        let mut rng = XorShift::new(0x9E37_79B9_7F4A_7C15);
+        let mut data = Vec::new();
+        let mut valid = Vec::new();
+        for i in 0..100_000 {
+            let value = rng.next_u128() >> (i % 129).min(127);
+            match i % 1009 {
+                0 => data.extend_from_slice(format!("{:x}g ", value).as_bytes()),
+                _ => {
+                    data.extend_from_slice(format!("{:x} ", value).as_bytes());
+                    valid.push(value);
+                }
+            }
+        }
+        assert!(data.len() >= PARALLEL_MIN_BYTES);
+
+        // The sum of the low and high 64-bit halves each fit a u128.
+        let low: u128 = valid.iter().map(|&v| v as u64 as u128).sum();
+        let high: u128 = valid.iter().map(|&v| v >> 64).sum();
+        let high = high + (low >> 64);
+        let sum = [low as u64, high as u64, (high >> 64) as u64];
+        let sum = BigUint::from_limbs(
+            sum.iter()
+                .flat_map(|&w| [w as u32, (w >> 32) as u32])
+                .collect(),
+        );
+
+        let plan = ConversionPlan::new(NumSystem::Hex, NumSystem::Dec, 0, 1, Separators::none());
+        for threads in [1, 4] {
+            let mut errors = 0;
+            let stats = aggregate(&data, &AggregateConfig::new(plan, threads), &mut |_| {
+                errors += 1
+            });
+            assert_eq!(stats.count, valid.len() as u64);
+            assert_eq!((stats.invalid, errors), (100, 100));
+            assert_eq!(stats.min, valid.iter().copied().min());
+            assert_eq!(stats.max, valid.iter().copied().max());
+            assert_eq!(stats.sum(), sum);
+            assert!(stats.sum().bits() > 128);
+            for (width, &count) in stats.widths.iter().enumerate() {
+                let expected = valid
+                    .iter()
+                    .filter(|&&v| (128 - v.leading_zeros()) as usize == width)
+                    .count();
+                assert_eq!(count, expected as u64, "width {}", width);
+            }
+        }
+    }
+}
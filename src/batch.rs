@@ -0,0 +1,1378 @@
+//! Batch conversion of number files.
+//!
+//! [`convert_file`] converts every whitespace-separated token of an input file and writes one
+//! converted number per line. The work is split into three stages:
+//!
+//! 1. A reader cuts the input into chunks. With [`IoBackend::Mmap`] the chunks are slices of
+//!    the mapped file; the streaming backends read into a fixed pool of buffers and pass
+//!    tokens that straddle two buffers along as a small "seam".
+//! 2. Worker threads convert chunks into output buffers.
+//! 3. The calling thread puts the output buffers back into input order and writes them.
+//!    Output buffers the sink is done with go back to the workers for reuse.
+use crate::budget::{Budget, Charges};
+use crate::checkpoint::{Checkpoint, Checkpointer, OutputLayout};
+use crate::input::{split_at_whitespace, tokens};
+use crate::metrics::{self, Counter};
+use crate::trace;
+use crate::{lanes, small_table, ConversionPlan, MappedFile, TokenError};
+use clap::ValueEnum;
+use std::collections::BTreeMap;
+use std::fmt::Display;
+use std::fs::File;
+use std::io::{self, Read, Seek, SeekFrom, Write};
+use std::ops::Range;
+use std::path::Path;
+use std::sync::mpsc::{self, Receiver, Sender, SyncSender};
+use std::sync::Mutex;
+use std::time::{Duration, Instant};
+
+/// The default size of an input chunk in bytes.
+pub const DEFAULT_CHUNK_SIZE: usize = 1 << 20;
+
+/// The smallest chunk size that a memory budget shrinks chunks to.
+const MIN_BUDGET_CHUNK_SIZE: usize = 4096;
+
+/// The number of reads the io_uring backend keeps in flight.
+const URING_READ_DEPTH: usize = 8;
+
+/// The number of writes the io_uring backend keeps in flight.
+const URING_WRITE_DEPTH: usize = 8;
+
+/// The number of tokens the scalar path parses before it formats them.
+const CONVERT_BATCH: usize = 64;
+
+/// How the batch modes read their input and write their output.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, ValueEnum)]
+pub enum IoBackend {
+    /// Memory-map the input and write with plain `write` calls.
+    Mmap,
+    /// Read the input with plain `read` calls into a pool of buffers, and write with plain
+    /// `write` calls.
+    Read,
+    /// Keep several reads in flight over registered buffers, and submit output file writes
+    /// asynchronously, with io_uring. Falls back to read when io_uring is unavailable.
+    IoUring,
+}
+
+impl Display for IoBackend {
+    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+        match self {
+            IoBackend::Mmap => write!(f, "mmap"),
+            IoBackend::Read => write!(f, "read"),
+            IoBackend::IoUring => write!(f, "io_uring"),
+        }
+    }
+}
+
+/// Configuration for a batch file conversion.
+pub struct BatchConfig {
+    /// How to convert each number.
+    pub plan: ConversionPlan,
+    /// The number of worker threads (0 to use all available cores).
+    pub threads: usize,
+    /// The size of an input chunk in bytes.
+    pub chunk_size: usize,
+    /// How to read the input and write the output.
+    pub backend: IoBackend,
+    /// The most memory to use for buffers and queued chunks in bytes (0 for no limit).
+    pub max_memory: usize,
+}
+
+impl BatchConfig {
+    pub fn new(
+        plan: ConversionPlan,
+        threads: usize,
+        chunk_size: usize,
+        backend: IoBackend,
+        max_memory: usize,
+    ) -> BatchConfig {
+        BatchConfig {
+            plan,
+            threads,
+            chunk_size,
+            backend,
+            max_memory,
+        }
+    }
+}
+
+/// The result of a batch file conversion.
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct BatchReport {
+    /// The number of tokens converted.
+    pub converted: usize,
+    /// The number of tokens that failed to convert.
+    pub failed: usize,
+    /// The number of input bytes processed.
+    pub bytes_in: u64,
+    /// The number of output bytes written.
+    pub bytes_out: u64,
+    /// The I/O backend that was actually used.
+    pub backend: Option<IoBackend>,
+    /// The number of files converted.
+    pub files: usize,
+    /// The number of files that could not be read or written.
+    pub files_failed: usize,
+    /// The most memory held at once by buffers and queued chunks, in bytes.
+    pub peak_memory: usize,
+}
+
+impl BatchReport {
+    /// Adds the counts of `other` to this report.
+    pub fn add(&mut self, other: &BatchReport) {
+        self.converted += other.converted;
+        self.failed += other.failed;
+        self.bytes_in += other.bytes_in;
+        self.bytes_out += other.bytes_out;
+        self.backend = self.backend.or(other.backend);
+        self.files += other.files;
+        self.files_failed += other.files_failed;
+        self.peak_memory = self.peak_memory.max(other.peak_memory);
+    }
+}
+
+/// A buffer of the streaming readers' pool, holding `len` bytes read at `offset`.
+struct Block {
+    slot: usize,
+    offset: u64,
+    data: Vec<u8>,
+    len: usize,
+}
+
+/// A unit of work for the converter threads.
+enum Job<'a> {
+    /// A slice of the mapped input starting at `offset`.
+    Mapped {
+        seq: u64,
+        offset: u64,
+        data: &'a [u8],
+    },
+    /// A token straddling the previous buffer (the seam) and/or whole tokens in `body`.
+    Block {
+        seq: u64,
+        seam: Option<(u64, Vec<u8>)>,
+        block: Option<Block>,
+        body: Range<usize>,
+    },
+}
+
+impl Job<'_> {
+    /// Returns the job's position in the input order.
+    fn seq(&self) -> u64 {
+        match self {
+            Job::Mapped { seq, .. } | Job::Block { seq, .. } => *seq,
+        }
+    }
+
+    /// Returns the number of input bytes the job covers.
+    fn input_len(&self) -> usize {
+        match self {
+            Job::Mapped { data, .. } => data.len(),
+            Job::Block { seam, body, .. } => seam.as_ref().map_or(0, |(_, s)| s.len()) + body.len(),
+        }
+    }
+
+    /// Returns the memory charged to the budget for the job's output.
+    fn charge(&self, plan: &ConversionPlan) -> usize {
+        (self.input_len() as f64 * plan.output_ratio()).ceil() as usize
+    }
+}
+
+/// The converted form of one job.
+struct ChunkOutput {
+    seq: u64,
+    /// The memory charged to the budget for this chunk.
+    charge: usize,
+    /// The input offset up to which the chunk's numbers are converted.
+    input_end: u64,
+    data: Vec<u8>,
+    converted: usize,
+    errors: Vec<TokenError>,
+    /// The numbers formatted one at a time with the small-value table enabled and how many
+    /// of them it held. Blocks formatted by the lane kernels do not consult the table.
+    table_lookups: usize,
+    table_hits: usize,
+}
+
+impl ChunkOutput {
+    fn new(seq: u64, charge: usize, data: Vec<u8>) -> ChunkOutput {
+        ChunkOutput {
+            seq,
+            charge,
+            input_end: 0,
+            data,
+            converted: 0,
+            errors: Vec::new(),
+            table_lookups: 0,
+            table_hits: 0,
+        }
+    }
+
+    /// Converts every token of `data`, which starts at input offset `offset`.
+    ///
+    /// The trace gets a "parse" and a "format" span for the chunk either way. The lane
+    /// kernels run the two stages one after the other, so their spans are measured directly.
+    /// The scalar path alternates between them every [`CONVERT_BATCH`] tokens, so its spans
+    /// are the time spent in each stage, laid end to end from the start of the chunk.
+    fn convert(&mut self, plan: &ConversionPlan, data: &[u8], offset: u64) {
+        self.data
+            .reserve((data.len() as f64 * plan.output_ratio()).ceil() as usize);
+        match plan.kernels.lanes {
+            true => self.convert_lanes(plan, data, offset),
+            false => self.convert_scalar(plan, data, offset),
+        }
+        self.input_end = offset + data.len() as u64;
+    }
+
+    /// Returns the bound below which the small-value table formats numbers.
+    fn table_bound(plan: &ConversionPlan) -> u128 {
+        match plan.kernels.table {
+            true => small_table(plan.tgt_base).bound(),
+            false => 0,
+        }
+    }
+
+    /// Converts the tokens of `data` with the lane kernels, parsing all of them and then
+    /// formatting all of them.
+    fn convert_lanes(&mut self, plan: &ConversionPlan, data: &[u8], offset: u64) {
+        let started = trace::start();
+        let (positions, tokens): (Vec<usize>, Vec<&[u8]>) = tokens(data).unzip();
+        let parsed = lanes::parse_tokens(plan, &tokens);
+        trace::span("parse", started, Some(self.seq), Some(data.len() as u64));
+
+        let (started, len) = (trace::start(), self.data.len());
+        let (table, table_bound) = (plan.kernels.table, ChunkOutput::table_bound(plan));
+        self.converted += lanes::format_tokens(
+            plan,
+            &tokens,
+            &parsed,
+            &mut self.data,
+            &mut |i, error| {
+                self.errors.push(TokenError {
+                    offset: offset as usize + positions[i],
+                    error,
+                })
+            },
+            &mut |value| {
+                self.table_lookups += table as usize;
+                self.table_hits += (value < table_bound) as usize;
+            },
+        );
+        let written = (self.data.len() - len) as u64;
+        trace::span("format", started, Some(self.seq), Some(written));
+    }
+
+    /// Converts the tokens of `data` in turns of up to [`CONVERT_BATCH`] tokens: it parses
+    /// the tokens of a turn into a small array and then formats them.
+    fn convert_scalar(&mut self, plan: &ConversionPlan, data: &[u8], offset: u64) {
+        let started = trace::start();
+        let (mut parsing, mut formatting) = (Duration::ZERO, Duration::ZERO);
+        let (len, table_bound) = (self.data.len(), ChunkOutput::table_bound(plan));
+        let mut tokens = tokens(data);
+        let mut values = [0u128; CONVERT_BATCH];
+        loop {
+            let turn = started.map(|_| Instant::now());
+            let mut parsed = 0;
+            let mut exhausted = true;
+            for (pos, token) in tokens.by_ref() {
+                match plan.parse_bytes(token) {
+                    Ok(value) => values[parsed] = value,
+                    Err(error) => {
+                        self.errors.push(TokenError {
+                            offset: offset as usize + pos,
+                            error,
+                        });
+                        continue;
+                    }
+                }
+                parsed += 1;
+                if parsed == CONVERT_BATCH {
+                    exhausted = false;
+                    break;
+                }
+            }
+
+            let parsed_at = turn.map(|turn| {
+                parsing += turn.elapsed();
+                Instant::now()
+            });
+            for &value in &values[..parsed] {
+                plan.format_into(value, &mut self.data);
+                self.data.push(b'\n');
+                self.table_hits += (value < table_bound) as usize;
+            }
+            if let Some(parsed_at) = parsed_at {
+                formatting += parsed_at.elapsed();
+            }
+            self.converted += parsed;
+            if plan.kernels.table {
+                self.table_lookups += parsed;
+            }
+            if exhausted {
+                break;
+            }
+        }
+
+        if let Some(started) = started {
+            let written = (self.data.len() - len) as u64;
+            trace::span_lasting(
+                "parse",
+                started,
+                parsing,
+                Some(self.seq),
+                Some(data.len() as u64),
+            );
+            trace::span_lasting(
+                "format",
+                started + parsing,
+                formatting,
+                Some(self.seq),
+                Some(written),
+            );
+        }
+    }
+}
+
+/// Turns a stream of in-order buffers into jobs, carrying tokens cut at buffer boundaries.
+struct Seamer {
+    seq: u64,
+    carry: Vec<u8>,
+    carry_offset: u64,
+}
+
+impl Seamer {
+    fn new() -> Seamer {
+        Seamer {
+            seq: 0,
+            carry: Vec::new(),
+            carry_offset: 0,
+        }
+    }
+
+    /// Splits off the tokens of `block` that are complete.
+    ///
+    /// # Returns
+    /// * `Ok(Job)` - The job for the next complete tokens.
+    /// * `Err(Block)` - The block, unused, if it only continued an unfinished token.
+    fn job<'a>(&mut self, block: Block) -> Result<Job<'a>, Block> {
+        let data = &block.data[..block.len];
+        let Some(first) = data.iter().position(u8::is_ascii_whitespace) else {
+            if self.carry.is_empty() {
+                self.carry_offset = block.offset;
+            }
+            self.carry.extend_from_slice(data);
+            return Err(block);
+        };
+        let last = data
+            .iter()
+            .rposition(u8::is_ascii_whitespace)
+            .unwrap_or(first);
+
+        let (seam, body_start) = if self.carry.is_empty() {
+            (None, 0)
+        } else {
+            let mut seam = std::mem::take(&mut self.carry);
+            seam.extend_from_slice(&data[..first]);
+            (Some((self.carry_offset, seam)), first)
+        };
+        self.carry.extend_from_slice(&data[last + 1..]);
+        self.carry_offset = block.offset + last as u64 + 1;
+
+        self.seq += 1;
+        Ok(Job::Block {
+            seq: self.seq - 1,
+            seam,
+            block: Some(block),
+            body: body_start..last + 1,
+        })
+    }
+
+    /// Returns the job for a token left unfinished at the end of the input, if any.
+    fn finish<'a>(&mut self) -> Option<Job<'a>> {
+        if self.carry.is_empty() {
+            return None;
+        }
+        self.seq += 1;
+        Some(Job::Block {
+            seq: self.seq - 1,
+            seam: Some((self.carry_offset, std::mem::take(&mut self.carry))),
+            block: None,
+            body: 0..0,
+        })
+    }
+}
+
+/// Receives the converted chunks and writes them out in input order.
+trait Sink {
+    /// Writes `data`, pushing buffers that are no longer in use, this one or earlier ones, to
+    /// `spent`.
+    fn write(&mut self, data: Vec<u8>, spent: &mut Vec<Vec<u8>>) -> io::Result<()>;
+    /// Waits until everything written so far is on disk.
+    fn sync(&mut self) -> io::Result<()>;
+    fn finish(&mut self) -> io::Result<()>;
+}
+
+/// Output that can be flushed to disk.
+trait SyncData {
+    fn sync_data(&self) -> io::Result<()>;
+}
+
+impl SyncData for File {
+    fn sync_data(&self) -> io::Result<()> {
+        File::sync_data(self)
+    }
+}
+
+impl SyncData for io::StdoutLock<'_> {
+    fn sync_data(&self) -> io::Result<()> {
+        Err(io::Error::new(
+            io::ErrorKind::Unsupported,
+            "checkpoints need an output file",
+        ))
+    }
+}
+
+struct WriteSink<W: Write + SyncData>(W);
+
+impl<W: Write + SyncData> Sink for WriteSink<W> {
+    fn write(&mut self, data: Vec<u8>, spent: &mut Vec<Vec<u8>>) -> io::Result<()> {
+        self.0.write_all(&data)?;
+        spent.push(data);
+        Ok(())
+    }
+
+    fn sync(&mut self) -> io::Result<()> {
+        self.0.flush()?;
+        self.0.sync_data()
+    }
+
+    fn finish(&mut self) -> io::Result<()> {
+        self.0.flush()
+    }
+}
+
+/// Writes output chunks with several io_uring writes in flight.
+#[cfg(target_os = "linux")]
+struct UringSink {
+    ring: crate::uring::IoUring,
+    file: File,
+    offset: u64,
+    next_id: u64,
+    /// In-flight writes: the buffer, its file offset, and how much of it is written.
+    in_flight: std::collections::HashMap<u64, (Vec<u8>, u64, usize)>,
+}
+
+#[cfg(target_os = "linux")]
+impl UringSink {
+    /// Creates a sink that writes `file` from `offset` on.
+    fn new(file: File, offset: u64) -> io::Result<UringSink> {
+        Ok(UringSink {
+            ring: crate::uring::IoUring::new(URING_WRITE_DEPTH as u32)?,
+            file,
+            offset,
+            next_id: 0,
+            in_flight: std::collections::HashMap::new(),
+        })
+    }
+
+    fn submit(&mut self, id: u64) {
+        use std::os::unix::io::AsRawFd;
+
+        let (data, offset, done) = &self.in_flight[&id];
+        let sqe = crate::uring::Sqe::write(
+            self.file.as_raw_fd(),
+            data[*done..].as_ptr(),
+            (data.len() - done).min(u32::MAX as usize) as u32,
+            offset + *done as u64,
+            id,
+        );
+        // SAFETY: the buffer stays in `in_flight`, unmoved, until its completion is reaped.
+        // The ring has at least URING_WRITE_DEPTH entries, and no more are ever in flight.
+        let pushed = unsafe { self.ring.push(sqe) };
+        debug_assert!(pushed);
+    }
+
+    /// Waits for at least one write to complete, resubmitting short writes.
+    fn reap(&mut self, spent: &mut Vec<Vec<u8>>) -> io::Result<()> {
+        self.ring.submit_and_wait(1)?;
+        while let Some(cqe) = self.ring.pop() {
+            if cqe.res < 0 {
+                return Err(io::Error::from_raw_os_error(-cqe.res));
+            }
+            let entry = self
+                .in_flight
+                .get_mut(&cqe.user_data)
+                .expect("completion for a known write");
+            entry.2 += cqe.res as usize;
+            if cqe.res == 0 {
+                return Err(io::ErrorKind::WriteZero.into());
+            }
+            if entry.2 < entry.0.len() {
+                self.submit(cqe.user_data);
+            } else if let Some((data, _, _)) = self.in_flight.remove(&cqe.user_data) {
+                spent.push(data);
+            }
+        }
+        Ok(())
+    }
+}
+
+#[cfg(target_os = "linux")]
+impl Sink for UringSink {
+    fn write(&mut self, data: Vec<u8>, spent: &mut Vec<Vec<u8>>) -> io::Result<()> {
+        while self.in_flight.len() >= URING_WRITE_DEPTH {
+            self.reap(spent)?;
+        }
+        let id = self.next_id;
+        self.next_id += 1;
+        let len = data.len() as u64;
+        self.in_flight.insert(id, (data, self.offset, 0));
+        self.offset += len;
+        self.submit(id);
+        self.ring.submit_and_wait(0)
+    }
+
+    fn sync(&mut self) -> io::Result<()> {
+        while !self.in_flight.is_empty() {
+            self.reap(&mut Vec::new())?;
+        }
+        self.file.sync_data()
+    }
+
+    fn finish(&mut self) -> io::Result<()> {
+        while !self.in_flight.is_empty() {
+            self.reap(&mut Vec::new())?;
+        }
+        // Writes at explicit offsets do not move the file position, so set the length.
+        self.file.set_len(self.offset)
+    }
+}
+
+/// What became of a block handed to the job queue.
+enum Emitted {
+    /// The block is queued for conversion and comes back through the free list.
+    Queued,
+    /// The block only continued an unfinished token and can be reused right away.
+    Unused(Block),
+    /// The converters have stopped.
+    Closed,
+}
+
+/// Reads `file` sequentially from offset `start` into blocks from the pool.
+///
+/// Returns the number of bytes read.
+fn read_blocks(
+    mut file: File,
+    start: u64,
+    mut spare: Vec<Block>,
+    free: &Receiver<Block>,
+    mut emit: impl FnMut(Block) -> Emitted,
+) -> io::Result<u64> {
+    let mut offset = file.seek(SeekFrom::Start(start))?;
+    loop {
+        let Some(mut block) = spare.pop().or_else(|| free.recv().ok()) else {
+            return Ok(offset - start);
+        };
+        block.len = 0;
+        let (started, traced) = (metrics::start_timer(), trace::start());
+        while block.len < block.data.len() {
+            match file.read(&mut block.data[block.len..]) {
+                Ok(0) => break,
+                Ok(n) => block.len += n,
+                Err(e) if e.kind() == io::ErrorKind::Interrupted => (),
+                Err(e) => return Err(e),
+            }
+        }
+        metrics::count_time(Counter::ReadNanos, started);
+        trace::span("read", traced, None, Some(block.len as u64));
+        if block.len == 0 {
+            return Ok(offset - start);
+        }
+        block.offset = offset;
+        offset += block.len as u64;
+        match emit(block) {
+            Emitted::Queued => (),
+            Emitted::Unused(block) => spare.push(block),
+            Emitted::Closed => return Ok(offset - start),
+        }
+    }
+}
+
+/// Reads `file` from offset `start` with several fixed-buffer reads in flight and emits the
+/// blocks in order.
+///
+/// Returns the number of bytes read.
+#[cfg(target_os = "linux")]
+fn uring_read_blocks(
+    mut ring: crate::uring::IoUring,
+    file: File,
+    start: u64,
+    mut spare: Vec<Block>,
+    free: &Receiver<Block>,
+    mut emit: impl FnMut(Block) -> Emitted,
+) -> io::Result<u64> {
+    use crate::uring::Sqe;
+    use std::collections::HashMap;
+    use std::os::unix::io::AsRawFd;
+
+    struct InFlight {
+        index: u64,
+        block: Block,
+        want: usize,
+    }
+
+    fn submit(ring: &mut crate::uring::IoUring, fd: i32, read: &mut InFlight) {
+        let block = &mut read.block;
+        let sqe = Sqe::read_fixed(
+            fd,
+            block.data[block.len..].as_mut_ptr(),
+            (read.want - block.len) as u32,
+            block.offset + block.len as u64,
+            block.slot as u16,
+            block.slot as u64,
+        );
+        // SAFETY: the block's buffer is registered and stays in `in_flight`, unmoved,
+        // until its completion is reaped. The ring has an entry for every buffer.
+        let pushed = unsafe { ring.push(sqe) };
+        debug_assert!(pushed);
+    }
+
+    let fd = file.as_raw_fd();
+    let size = file.metadata()?.len();
+    let mut next_offset = start;
+    let mut next_index = 0u64;
+    let mut next_emit = 0u64;
+    let mut bytes_read = 0u64;
+    let mut in_flight: HashMap<usize, InFlight> = HashMap::new();
+    let mut done: BTreeMap<u64, Block> = BTreeMap::new();
+
+    loop {
+        // Keep every free buffer busy with the next part of the file.
+        while next_offset < size {
+            let block = match spare.pop().or_else(|| free.try_recv().ok()) {
+                Some(block) => block,
+                None if in_flight.is_empty() => match free.recv() {
+                    Ok(block) => block,
+                    Err(_) => return Ok(bytes_read),
+                },
+                None => break,
+            };
+            let want = (size - next_offset).min(block.data.len() as u64) as usize;
+            let mut read = InFlight {
+                index: next_index,
+                block: Block {
+                    offset: next_offset,
+                    len: 0,
+                    ..block
+                },
+                want,
+            };
+            submit(&mut ring, fd, &mut read);
+            in_flight.insert(read.block.slot, read);
+            next_offset += want as u64;
+            next_index += 1;
+        }
+        if in_flight.is_empty() {
+            return Ok(bytes_read);
+        }
+
+        let (started, traced) = (metrics::start_timer(), trace::start());
+        ring.submit_and_wait(1)?;
+        metrics::count_time(Counter::ReadNanos, started);
+        trace::span("read", traced, None, None);
+        while let Some(cqe) = ring.pop() {
+            let slot = cqe.user_data as usize;
+            let read = in_flight
+                .get_mut(&slot)
+                .expect("completion for a known read");
+            if cqe.res < 0 {
+                in_flight.remove(&slot);
+                drain(&mut ring, &mut in_flight)?;
+                return Err(io::Error::from_raw_os_error(-cqe.res));
+            }
+            read.block.len += cqe.res as usize;
+            if cqe.res == 0 {
+                // The file shrank while being read.
+                read.want = read.block.len;
+            }
+            if read.block.len < read.want {
+                submit(&mut ring, fd, read);
+            } else {
+                let read = in_flight.remove(&slot).expect("known read");
+                done.insert(read.index, read.block);
+            }
+        }
+
+        while let Some(block) = done.remove(&next_emit) {
+            next_emit += 1;
+            bytes_read += block.len as u64;
+            if block.len == 0 {
+                spare.push(block);
+                continue;
+            }
+            match emit(block) {
+                Emitted::Queued => (),
+                Emitted::Unused(block) => spare.push(block),
+                Emitted::Closed => return drain(&mut ring, &mut in_flight).map(|_| bytes_read),
+            }
+        }
+    }
+
+    /// Waits for the remaining reads so their buffers are no longer in use.
+    fn drain(
+        ring: &mut crate::uring::IoUring,
+        in_flight: &mut HashMap<usize, InFlight>,
+    ) -> io::Result<()> {
+        while !in_flight.is_empty() {
+            ring.submit_and_wait(1)?;
+            while let Some(cqe) = ring.pop() {
+                in_flight.remove(&(cqe.user_data as usize));
+            }
+        }
+        Ok(())
+    }
+}
+
+/// Charges `job` to the budget and queues it for the workers.
+///
+/// Returns `false` if the converters have stopped.
+fn queue<'a>(
+    job: Job<'a>,
+    jobs: &SyncSender<Job<'a>>,
+    plan: &ConversionPlan,
+    charges: &Charges,
+) -> bool {
+    let (started, seq, len) = (trace::start(), job.seq(), job.input_len() as u64);
+    let queued = charges.acquire(job.charge(plan)) && jobs.send(job).is_ok();
+    trace::span("queue", started, Some(seq), Some(len));
+    queued
+}
+
+/// Converts jobs until the job queue is closed or the writer has stopped.
+fn work(
+    plan: &ConversionPlan,
+    jobs: &Mutex<Receiver<Job>>,
+    results: SyncSender<ChunkOutput>,
+    free: Sender<Block>,
+    spare: &Spare,
+    charges: &Charges,
+) {
+    trace::name_thread("worker");
+    loop {
+        let job = match jobs.lock().expect("job queue poisoned").recv() {
+            Ok(job) => job,
+            Err(_) => return,
+        };
+        let buffer = spare.buffers.lock().expect("buffer pool poisoned").pop();
+        let buffer = buffer.inspect(|b| charges.unhold(b.capacity()));
+        let (buffer, charge) = (buffer.unwrap_or_default(), job.charge(plan));
+        let (started, input_len) = (metrics::start_timer(), job.input_len());
+        let output = match job {
+            Job::Mapped { seq, offset, data } => {
+                let mut output = ChunkOutput::new(seq, charge, buffer);
+                output.convert(plan, data, offset);
+                output
+            }
+            Job::Block {
+                seq,
+                seam,
+                block,
+                body,
+            } => {
+                let mut output = ChunkOutput::new(seq, charge, buffer);
+                if let Some((offset, seam)) = seam {
+                    output.convert(plan, &seam, offset);
+                }
+                if let Some(block) = block {
+                    output.convert(
+                        plan,
+                        &block.data[body.clone()],
+                        block.offset + body.start as u64,
+                    );
+                    let _ = free.send(block);
+                }
+                output
+            }
+        };
+        if started.is_some() {
+            metrics::observe_chunk(started);
+            metrics::count(Counter::BytesRead, input_len as u64);
+            metrics::count(Counter::TableLookups, output.table_lookups as u64);
+            metrics::count(Counter::TableHits, output.table_hits as u64);
+        }
+        if results.send(output).is_err() {
+            return;
+        }
+    }
+}
+
+/// Puts converted chunks back into input order and writes them to `sink`.
+///
+/// Each chunk's charge is released once it is written, and output buffers the sink is done
+/// with go back to `spare`. With a `checkpointer`, the output is synced and a checkpoint
+/// stored whenever one is due, and once more at the end.
+fn write_in_order(
+    results: Receiver<ChunkOutput>,
+    sink: &mut dyn Sink,
+    spare: &Spare,
+    charges: &Charges,
+    mut checkpointer: Option<Checkpointer>,
+    report: &mut BatchReport,
+    on_error: &mut dyn FnMut(TokenError),
+) -> io::Result<()> {
+    let mut pending = BTreeMap::new();
+    let mut next = 0;
+    let mut spent = Vec::new();
+    trace::name_thread("writer");
+    loop {
+        // Time spent here is time the next chunk in order is not ready yet.
+        let started = trace::start();
+        let Ok(output) = results.recv() else { break };
+        trace::span("reorder wait", started, None, None);
+        pending.insert(output.seq, output);
+        while let Some(output) = pending.remove(&next) {
+            next += 1;
+            report.converted += output.converted;
+            report.failed += output.errors.len();
+            report.bytes_out += output.data.len() as u64;
+            if metrics::enabled() {
+                metrics::count(Counter::Converted, output.converted as u64);
+                metrics::count(Counter::BytesWritten, output.data.len() as u64);
+                output
+                    .errors
+                    .iter()
+                    .for_each(|e| metrics::count_error(&e.error));
+            }
+            output.errors.into_iter().for_each(&mut *on_error);
+            let written = output.data.len();
+            if written > 0 {
+                let (started, traced) = (metrics::start_timer(), trace::start());
+                sink.write(output.data, &mut spent)?;
+                metrics::count_time(Counter::WriteNanos, started);
+                trace::span("write", traced, Some(output.seq), Some(written as u64));
+            }
+            charges.release(output.charge);
+            if let Some(checkpointer) = &mut checkpointer {
+                if checkpointer.advance(output.input_end, written) {
+                    sink.sync()?;
+                    checkpointer.store()?;
+                }
+            }
+            if !spent.is_empty() {
+                let mut buffers = spare.buffers.lock().expect("buffer pool poisoned");
+                for mut data in spent.drain(..) {
+                    if buffers.len() < spare.keep {
+                        data.clear();
+                        charges.hold(data.capacity());
+                        buffers.push(data);
+                    }
+                }
+            }
+        }
+    }
+    sink.finish()?;
+    if let Some(checkpointer) = &mut checkpointer {
+        sink.sync()?;
+        checkpointer.store()?;
+    }
+    Ok(())
+}
+
+/// Cleared output buffers kept for reuse by the workers.
+struct Spare {
+    buffers: Mutex<Vec<Vec<u8>>>,
+    /// The most buffers to keep.
+    keep: usize,
+}
+
+/// Opens the output sink.
+///
+/// An output file is written through io_uring with [`IoBackend::IoUring`]. Everything else,
+/// and whatever the kernel does not support, falls back to plain writes. An output file is
+/// truncated to `keep` bytes and written from there on.
+fn open_sink(output: Option<&Path>, backend: IoBackend, keep: u64) -> io::Result<Box<dyn Sink>> {
+    let Some(path) = output else {
+        return Ok(Box::new(WriteSink(io::stdout().lock())));
+    };
+    let mut file = match keep {
+        0 => File::create(path)?,
+        _ => std::fs::OpenOptions::new().write(true).open(path)?,
+    };
+    file.set_len(keep)?;
+    file.seek(SeekFrom::Start(keep))?;
+    #[cfg(target_os = "linux")]
+    if backend == IoBackend::IoUring {
+        if let Ok(sink) = UringSink::new(file.try_clone()?, keep) {
+            return Ok(Box::new(sink));
+        }
+    }
+    let _ = backend;
+    Ok(Box::new(WriteSink(file)))
+}
+
+/// Fails if `input` and `output` are the same file, which would be truncated before it is read.
+fn ensure_distinct(input: &Path, output: Option<&Path>) -> io::Result<()> {
+    let Some(output) = output else {
+        return Ok(());
+    };
+    match (input.canonicalize(), output.canonicalize()) {
+        (Ok(a), Ok(b)) if a == b => Err(io::Error::new(
+            io::ErrorKind::InvalidInput,
+            "input and output are the same file",
+        )),
+        _ => Ok(()),
+    }
+}
+
+/// Returns the chunk size to use, shrunk if needed so that the read buffers and the output of
+/// the chunks that can be queued at once fit in the memory budget.
+fn budget_chunk_size(config: &BatchConfig, slots: usize, threads: usize) -> usize {
+    let chunk_size = config.chunk_size.max(1);
+    if config.max_memory == 0 {
+        return chunk_size;
+    }
+    // The job and result queues hold two chunks per worker, plus one in progress.
+    let per_byte = slots as f64 + (threads * 3) as f64 * config.plan.output_ratio();
+    let fit = (config.max_memory as f64 / per_byte) as usize;
+    chunk_size.min(fit.max(MIN_BUDGET_CHUNK_SIZE))
+}
+
+/// Sets up io_uring for reading into `pool`, or returns `None` if it is unavailable.
+#[cfg(target_os = "linux")]
+fn uring_reader(pool: &mut [Block]) -> Option<crate::uring::IoUring> {
+    let ring = crate::uring::IoUring::new(pool.len() as u32).ok()?;
+    let iovecs: Vec<libc::iovec> = pool
+        .iter_mut()
+        .map(|b| libc::iovec {
+            iov_base: b.data.as_mut_ptr() as *mut libc::c_void,
+            iov_len: b.data.len(),
+        })
+        .collect();
+    // SAFETY: the pool's buffers are never reallocated and outlive every read.
+    unsafe { ring.register_buffers(&iovecs) }.ok()?;
+    Some(ring)
+}
+
+/// Converts every whitespace-separated number of a file, one output line per number.
+///
+/// Numbers that fail to convert produce no output line; they are passed to `on_error` in
+/// input order, with the byte offset of the offending token.
+///
+/// # Arguments
+/// * `input` - The file to convert.
+/// * `output` - Where to write the converted numbers, or `None` for stdout.
+/// * `config` - The conversion plan, parallelism and I/O backend.
+/// * `on_error` - Called for every number that fails to convert.
+///
+/// # Returns
+/// * `Ok(BatchReport)` - Counts of converted and failed numbers and bytes processed.
+/// * `Err(io::Error)` - If the input could not be read or the output could not be written.
+pub fn convert_file(
+    input: &Path,
+    output: Option<&Path>,
+    config: &BatchConfig,
+    on_error: &mut dyn FnMut(TokenError),
+) -> io::Result<BatchReport> {
+    let budget = Budget::new(config.max_memory);
+    let mut report = convert_file_within(input, output, config, &budget, None, on_error)?;
+    report.peak_memory = budget.peak();
+    Ok(report)
+}
+
+/// Converts a file like [`convert_file`], storing checkpoints from which an interrupted
+/// conversion can be resumed.
+///
+/// Every [`CHECKPOINT_INTERVAL`](crate::CHECKPOINT_INTERVAL) the output is synced to disk and
+/// the progress stored in `checkpoint`, and once more when the conversion is complete.
+///
+/// # Arguments
+/// * `input` - The file to convert.
+/// * `output` - The file to write the converted numbers to.
+/// * `checkpoint` - Where to store checkpoints.
+/// * `resume` - Whether to continue from the checkpoint stored in `checkpoint`, keeping the
+///   output written up to it, rather than to start over.
+/// * `config` - The conversion plan, parallelism and I/O backend.
+/// * `on_error` - Called for every number that fails to convert.
+///
+/// # Returns
+/// * `Ok(BatchReport)` - Counts for the part of the input converted by this call.
+/// * `Err(io::Error)` - If a file could not be read or written, or the checkpoint does not
+///   match the input and output.
+pub fn convert_file_checkpointed(
+    input: &Path,
+    output: &Path,
+    checkpoint: &Path,
+    resume: bool,
+    config: &BatchConfig,
+    on_error: &mut dyn FnMut(TokenError),
+) -> io::Result<BatchReport> {
+    let input_len = input.metadata()?.len();
+    let layout = OutputLayout::of(&config.plan);
+    let start = match resume {
+        false => Checkpoint {
+            input_len,
+            layout,
+            ..Checkpoint::default()
+        },
+        true => {
+            let start = Checkpoint::load(checkpoint)?;
+            let mismatch = |what| Err(io::Error::new(io::ErrorKind::InvalidData, what));
+            if start.input_len != input_len || start.input_offset > input_len {
+                return mismatch("input changed since the checkpoint");
+            }
+            if output.metadata()?.len() < start.output_len {
+                return mismatch("output is shorter than at the checkpoint");
+            }
+            if start.layout != layout {
+                return mismatch("conversion options differ from the checkpoint");
+            }
+            start
+        }
+    };
+
+    let budget = Budget::new(config.max_memory);
+    let checkpointer = Checkpointer::new(checkpoint, start);
+    let mut report = convert_file_within(
+        input,
+        Some(output),
+        config,
+        &budget,
+        Some(checkpointer),
+        on_error,
+    )?;
+    report.peak_memory = budget.peak();
+    Ok(report)
+}
+
+/// Converts a file like [`convert_file`], charging its memory to a shared `budget`, and
+/// starting from the progress of `checkpointer` if given.
+///
+/// `config.max_memory` only sizes the chunks; the reader blocks on `budget`.
+pub(crate) fn convert_file_within(
+    input: &Path,
+    output: Option<&Path>,
+    config: &BatchConfig,
+    budget: &Budget,
+    checkpointer: Option<Checkpointer>,
+    on_error: &mut dyn FnMut(TokenError),
+) -> io::Result<BatchReport> {
+    let report = convert_one(input, output, config, budget, checkpointer, on_error);
+    match report {
+        Ok(_) => metrics::count(Counter::FilesConverted, 1),
+        Err(_) => metrics::count(Counter::FilesFailed, 1),
+    }
+    report
+}
+
+/// Converts a file for [`convert_file_within`].
+fn convert_one(
+    input: &Path,
+    output: Option<&Path>,
+    config: &BatchConfig,
+    budget: &Budget,
+    checkpointer: Option<Checkpointer>,
+    on_error: &mut dyn FnMut(TokenError),
+) -> io::Result<BatchReport> {
+    ensure_distinct(input, output)?;
+    let start = checkpointer
+        .as_ref()
+        .map_or(Checkpoint::default(), |c| c.progress());
+    let threads = crate::worker_threads(config.threads);
+
+    let mut backend = config.backend;
+    let mapped = match backend {
+        IoBackend::Mmap => Some(MappedFile::open(input)?),
+        _ => None,
+    };
+    let file = match backend {
+        IoBackend::Mmap => None,
+        _ => Some(File::open(input)?),
+    };
+
+    // Enough buffers to keep every worker busy while the next reads are in flight.
+    let slots = match backend {
+        IoBackend::Mmap => 0,
+        IoBackend::Read => threads + 2,
+        IoBackend::IoUring => threads + URING_READ_DEPTH,
+    };
+    let chunk_size = budget_chunk_size(config, slots, threads);
+    let mut pool: Vec<Block> = (0..slots)
+        .map(|slot| Block {
+            slot,
+            offset: 0,
+            data: vec![0; chunk_size],
+            len: 0,
+        })
+        .collect();
+    #[cfg(target_os = "linux")]
+    let ring = match backend {
+        IoBackend::IoUring => uring_reader(&mut pool),
+        _ => None,
+    };
+    #[cfg(not(target_os = "linux"))]
+    let ring: Option<()> = None;
+    if backend == IoBackend::IoUring && ring.is_none() {
+        backend = IoBackend::Read;
+    }
+    let mut sink = open_sink(output, backend, start.output_len)?;
+    let charges = budget.charges();
+    charges.hold(slots * chunk_size);
+
+    let mut report = BatchReport {
+        backend: Some(backend),
+        files: 1,
+        ..BatchReport::default()
+    };
+    let (free_tx, free_rx) = mpsc::channel();
+    let (job_tx, job_rx) = mpsc::sync_channel::<Job>(threads * 2);
+    let job_rx = std::sync::Arc::new(Mutex::new(job_rx));
+    let (result_tx, result_rx) = mpsc::sync_channel(threads * 2);
+    let spare = Spare {
+        buffers: Mutex::new(Vec::new()),
+        // Enough buffers for the results queue and one in progress per worker. Under a memory
+        // budget, spare buffers would crowd out chunks, so they are freed instead.
+        keep: match config.max_memory {
+            0 => threads * 3,
+            _ => 0,
+        },
+    };
+    let plan = &config.plan;
+    let charges = &charges;
+    let data: &[u8] = mapped.as_deref().unwrap_or(&[]);
+    let data = &data[(start.input_offset as usize).min(data.len())..];
+
+    std::thread::scope(|s| {
+        for _ in 0..threads {
+            let (jobs, results, free) = (job_rx.clone(), result_tx.clone(), free_tx.clone());
+            let spare = &spare;
+            s.spawn(move || work(plan, &jobs, results, free, spare, charges));
+        }
+        drop((job_rx, result_tx, free_tx));
+
+        let reader = s.spawn(move || -> io::Result<u64> {
+            trace::name_thread("reader");
+            let mut seamer = Seamer::new();
+            let send = |job| queue(job, &job_tx, plan, charges);
+            let emit = |block: Block| match seamer.job(block) {
+                Ok(job) => match send(job) {
+                    true => Emitted::Queued,
+                    false => Emitted::Closed,
+                },
+                Err(block) => Emitted::Unused(block),
+            };
+            let bytes_read = match (backend, file) {
+                (IoBackend::Mmap, _) => {
+                    let parts = data.len().div_ceil(chunk_size);
+                    for (seq, range) in split_at_whitespace(data, parts).into_iter().enumerate() {
+                        let job = Job::Mapped {
+                            seq: seq as u64,
+                            offset: start.input_offset + range.start as u64,
+                            data: &data[range],
+                        };
+                        if !send(job) {
+                            break;
+                        }
+                    }
+                    return Ok(data.len() as u64);
+                }
+                #[cfg(target_os = "linux")]
+                (IoBackend::IoUring, Some(file)) => {
+                    let ring = ring.expect("ring for the io_uring backend");
+                    uring_read_blocks(ring, file, start.input_offset, pool, &free_rx, emit)?
+                }
+                (_, Some(file)) => read_blocks(file, start.input_offset, pool, &free_rx, emit)?,
+                (_, None) => unreachable!("streaming backends open the input"),
+            };
+            if let Some(job) = seamer.finish() {
+                send(job);
+            }
+            Ok(bytes_read)
+        });
+
+        let written = write_in_order(
+            result_rx,
+            sink.as_mut(),
+            &spare,
+            charges,
+            checkpointer,
+            &mut report,
+            on_error,
+        );
+        // Wake the reader if it waits for memory that the writer will no longer release.
+        charges.close();
+        let read = reader.join().expect("reader panicked");
+        report.bytes_in = read?;
+        written
+    })?;
+
+    Ok(report)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{ConversionError, NumSystem, Separators};
+
+    fn convert_with(
+        backend: IoBackend,
+        chunk_size: usize,
+        input: &[u8],
+    ) -> (Vec<u8>, Vec<TokenError>, BatchReport) {
+        let dir = std::env::temp_dir();
+        let id = format!("{}-{:?}-{}", std::process::id(), backend, chunk_size);
+        let (src, dst) = (
+            dir.join(format!("nconv-batch-in-{}", id)),
+            dir.join(format!("nconv-batch-out-{}", id)),
+        );
+        std::fs::write(&src, input).unwrap();
+
+        let plan = ConversionPlan::new(NumSystem::Hex, NumSystem::Dec, 0, 1, Separators::none());
+        let config = BatchConfig::new(plan, 2, chunk_size, backend, 0);
+        let mut errors = Vec::new();
+        let report = convert_file(&src, Some(&dst), &config, &mut |e| errors.push(e)).unwrap();
+        let output = std::fs::read(&dst).unwrap();
+        std::fs::remove_file(&src).unwrap();
+        std::fs::remove_file(&dst).unwrap();
+        (output, errors, report)
+    }
+
+    #[test]
+    fn convert_file_agrees_across_backends_and_chunk_sizes() {
+        let mut input = Vec::new();
+        let mut expected = Vec::new();
+        for i in 0..2000u128 {
+            let value = i * i * 0x1_0000_0001;
+            input.extend_from_slice(
+                format!("{:#x}{}", value, if i % 7 == 0 { "\n" } else { "  " }).as_bytes(),
+            );
+            expected.extend_from_slice(format!("{}\n", value).as_bytes());
+        }
+        input.extend_from_slice(b"0xZZ ");
+        input.extend_from_slice(format!("{:x}", u128::MAX).as_bytes());
+        expected.extend_from_slice(format!("{}\n", u128::MAX).as_bytes());
+
+        for backend in [IoBackend::Mmap, IoBackend::Read, IoBackend::IoUring] {
+            for chunk_size in [1, 7, 64, 4096, DEFAULT_CHUNK_SIZE] {
+                let (output, errors, report) = convert_with(backend, chunk_size, &input);
+                assert!(
+                    output == expected,
+                    "{:?} with {} byte chunks",
+                    backend,
+                    chunk_size
+                );
+                assert_eq!(
+                    errors,
+                    [TokenError {
+                        offset: input.len() - 37,
+                        error: ConversionError::InvalidDigit('Z')
+                    }]
+                );
+                assert_eq!(report.converted, 2001);
+                assert_eq!(report.failed, 1);
+                assert_eq!(report.bytes_in, input.len() as u64);
+                assert_eq!(report.bytes_out, expected.len() as u64);
+            }
+        }
+    }
+
+    #[test]
+    fn convert_file_stays_within_a_memory_budget() {
+        let input: String = (0..100_000u64).map(|i| format!("{:x}\n", i * i)).collect();
+        let expected: String = (0..100_000u64).map(|i| format!("{}\n", i * i)).collect();
+        let path = std::env::temp_dir().join(format!("nconv-batch-budget-{}", std::process::id()));
+        std::fs::write(&path, &input).unwrap();
+        let out = path.with_extension("out");
+
+        let plan = ConversionPlan::new(NumSystem::Hex, NumSystem::Dec, 0, 1, Separators::none());
+        for backend in [IoBackend::Mmap, IoBackend::Read] {
+            let limit = 64 << 10;
+            let config = BatchConfig::new(plan, 4, DEFAULT_CHUNK_SIZE, backend, limit);
+            let report = convert_file(&path, Some(&out), &config, &mut |_| ()).unwrap();
+            assert_eq!(std::fs::read_to_string(&out).unwrap(), expected);
+            assert!(
+                report.peak_memory <= limit,
+                "{:?}: {}",
+                backend,
+                report.peak_memory
+            );
+
+            let config = BatchConfig::new(plan, 4, DEFAULT_CHUNK_SIZE, backend, 0);
+            let report = convert_file(&path, Some(&out), &config, &mut |_| ()).unwrap();
+            assert!(report.peak_memory > limit);
+        }
+        std::fs::remove_file(&path).unwrap();
+        std::fs::remove_file(&out).unwrap();
+    }
+
+    #[test]
+    fn convert_file_resumes_from_a_checkpoint() {
+        let input: String = (0..5000u64).map(|i| format!("{:x} ", i * 77)).collect();
+        let expected: String = (0..5000u64).map(|i| format!("{}\n", i * 77)).collect();
+        let path = std::env::temp_dir().join(format!("nconv-batch-resume-{}", std::process::id()));
+        let (out, ckpt) = (path.with_extension("out"), path.with_extension("ckpt"));
+        std::fs::write(&path, &input).unwrap();
+
+        // Pretend a run stopped after 1000 numbers, leaving a partial line after them.
+        let input_offset = input.match_indices(' ').nth(999).unwrap().0 as u64 + 1;
+        let output_len = expected.match_indices('\n').nth(999).unwrap().0 as u64 + 1;
+        let plan = ConversionPlan::new(NumSystem::Hex, NumSystem::Dec, 0, 1, Separators::none());
+        for backend in [IoBackend::Mmap, IoBackend::Read, IoBackend::IoUring] {
+            let partial = format!("{}38", &expected[..output_len as usize]);
+            std::fs::write(&out, partial).unwrap();
+            let checkpoint = Checkpoint {
+                input_len: input.len() as u64,
+                input_offset,
+                output_len,
+                layout: OutputLayout::of(&plan),
+            };
+            checkpoint.store(&ckpt).unwrap();
+
+            let config = BatchConfig::new(plan, 2, 512, backend, 0);
+            let report =
+                convert_file_checkpointed(&path, &out, &ckpt, true, &config, &mut |_| ()).unwrap();
+            assert_eq!(std::fs::read_to_string(&out).unwrap(), expected);
+            assert_eq!(report.converted, 4000);
+            assert_eq!(report.bytes_in, input.len() as u64 - input_offset);
+            let done = Checkpoint::load(&ckpt).unwrap();
+            assert_eq!(done.input_offset, input.len() as u64);
+            assert_eq!(done.output_len, expected.len() as u64);
+        }
+
+        // Resuming with other options would append output in another format.
+        let other = ConversionPlan::new(NumSystem::Hex, NumSystem::Bin, 0, 16, Separators::none());
+        let config = BatchConfig::new(other, 2, 512, IoBackend::Mmap, 0);
+        let error = convert_file_checkpointed(&path, &out, &ckpt, true, &config, &mut |_| ());
+        assert!(error.unwrap_err().to_string().contains("options differ"));
+
+        std::fs::write(&path, "10 20").unwrap();
+        let config = BatchConfig::new(plan, 2, 512, IoBackend::Mmap, 0);
+        assert!(convert_file_checkpointed(&path, &out, &ckpt, true, &config, &mut |_| ()).is_err());
+        for file in [&path, &out, &ckpt] {
+            std::fs::remove_file(file).unwrap();
+        }
+    }
+
+    #[test]
+    fn convert_file_handles_empty_and_whitespace_only_input() {
+        for backend in [IoBackend::Mmap, IoBackend::Read, IoBackend::IoUring] {
+            let (output, errors, report) = convert_with(backend, 4, b"");
+            assert!(output.is_empty() && errors.is_empty());
+            assert_eq!(report.converted, 0);
+
+            let (output, _, report) = convert_with(backend, 4, b" \n\n\t ");
+            assert!(output.is_empty());
+            assert_eq!(report.bytes_in, 5);
+        }
+    }
+
+    #[test]
+    fn convert_file_refuses_to_overwrite_its_input() {
+        let path = std::env::temp_dir().join(format!("nconv-batch-same-{}", std::process::id()));
+        std::fs::write(&path, b"0x10\n").unwrap();
+        let plan = ConversionPlan::new(NumSystem::Hex, NumSystem::Dec, 0, 1, Separators::none());
+        let config = BatchConfig::new(plan, 1, DEFAULT_CHUNK_SIZE, IoBackend::Mmap, 0);
+        assert!(convert_file(&path, Some(&path), &config, &mut |_| ()).is_err());
+        assert_eq!(std::fs::read(&path).unwrap(), b"0x10\n");
+        std::fs::remove_file(&path).unwrap();
+    }
+}
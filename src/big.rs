@@ -0,0 +1,763 @@
+//! Arbitrary-precision conversion for numbers beyond 128 bits.
+//!
+//! A [`BigUint`] holds a non-negative integer as little-endian `u32` limbs. Power-of-two bases
+//! are converted by moving bits directly. Decimal is converted by divide and conquer over the
+//! power tree `10^(9 * 2^k)`: parsing multiplies the high half of the digits by a power and
+//! adds the low half, and formatting divides by a power (with a Newton reciprocal for long
+//! divisors) and formats quotient and remainder separately. Both run in O(M(n) log n) for the
+//! multiplication time M(n) of [`crate::mul`].
+//!
+//! Formatting hands the digits to a [`DigitSink`] block by block as soon as they are final,
+//! so a number's text never has to be held in memory as a whole. The power tree can be kept
+//! on disk across runs with [`set_power_cache`](crate::set_power_cache).
+use crate::mul::{self, add_into, cmp, sub_into, trim, trimmed, MulThresholds};
+use crate::parser::{byte_char, DIGIT_VALUES};
+use crate::power_cache::{cached_powers, store_powers, PowerTable};
+use crate::{current_profile, ConversionError, NumSystem, Separators};
+use std::borrow::Cow;
+use std::cmp::Ordering;
+use std::io;
+use std::ops::{Deref, Range};
+use std::sync::Arc;
+
+/// Decimal digits per leaf of the power tree; `10^9` is the largest power of ten in a limb.
+const LEAF_DIGITS: usize = 9;
+const LEAF: u32 = 1_000_000_000;
+
+/// Digit strings up to this length are parsed by repeated multiply-add.
+const PARSE_BASE_DIGITS: usize = LEAF_DIGITS * 32;
+
+/// Values up to this many limbs are formatted by repeated division by [`LEAF`].
+const FORMAT_BASE_LIMBS: usize = 32;
+
+/// Divisors from this many limbs on are divided by multiplying with a reciprocal.
+const NEWTON_MIN_LIMBS: usize = 64;
+
+/// The most digits handed to a [`DigitSink`] at once when unpacking power-of-two digits or
+/// padding with zeros.
+const SINK_BLOCK: usize = 4096;
+
+/// Receives the digits of a number, most significant first.
+pub(crate) trait DigitSink {
+    /// Called once with the total number of digits, before any of them.
+    fn begin(&mut self, len: u64) -> io::Result<()>;
+
+    /// Receives the next block of digits.
+    fn push(&mut self, digits: &[u8]) -> io::Result<()>;
+}
+
+impl DigitSink for Vec<u8> {
+    fn begin(&mut self, len: u64) -> io::Result<()> {
+        self.reserve(len as usize);
+        Ok(())
+    }
+
+    fn push(&mut self, digits: &[u8]) -> io::Result<()> {
+        self.extend_from_slice(digits);
+        Ok(())
+    }
+}
+
+/// A non-negative integer of any size.
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct BigUint {
+    /// Little-endian limbs without leading zeros; zero has none.
+    limbs: Vec<u32>,
+}
+
+impl BigUint {
+    /// Creates a number from little-endian limbs.
+    pub fn from_limbs(mut limbs: Vec<u32>) -> BigUint {
+        trim(&mut limbs);
+        BigUint { limbs }
+    }
+
+    /// Returns the little-endian limbs, without leading zeros.
+    pub fn limbs(&self) -> &[u32] {
+        &self.limbs
+    }
+
+    /// Returns the number of significant bits.
+    pub fn bits(&self) -> u64 {
+        bit_len(&self.limbs)
+    }
+
+    /// Multiplies two numbers with the algorithms chosen by the current profile.
+    pub fn mul(&self, other: &BigUint) -> BigUint {
+        BigUint::from_limbs(mul::mul(&self.limbs, &other.limbs, current_profile().mul))
+    }
+
+    /// Parses a number of any length.
+    ///
+    /// The rules are those of [`Parser`](crate::Parser), without the 128-bit limit: an
+    /// optional `0b`/`0o`/`0x` prefix matching `base`, then digits of `base` with
+    /// `separators` skipped anywhere after the prefix. An empty number is zero.
+    ///
+    /// # Examples
+    ///
+    /// ```
+    /// use nconv::{BigUint, NumSystem, Separators};
+    ///
+    /// let n = BigUint::parse(b"0x1_0000_0000_0000_0000_0000_0000_0000_0000", NumSystem::Hex,
+    ///     Separators::new(b"_")).unwrap();
+    /// assert_eq!(n.bits(), 129);
+    /// assert_eq!(n.to_digits(NumSystem::Dec), b"340282366920938463463374607431768211456");
+    /// ```
+    pub fn parse(
+        num: &[u8],
+        base: NumSystem,
+        separators: Separators,
+    ) -> Result<BigUint, ConversionError> {
+        let digits = digit_values(num, base, separators)?;
+        let t = current_profile().mul;
+        let limbs = match base {
+            NumSystem::Dec => {
+                let mut powers = Powers::new();
+                let limbs = parse_decimal(&digits, &mut powers, t);
+                powers.store();
+                limbs
+            }
+            _ => pack_bits(&digits, (base as u32).trailing_zeros()),
+        };
+        Ok(BigUint::from_limbs(limbs))
+    }
+
+    /// Returns the digits of the number in `base`, most significant first, with upper-case
+    /// hexadecimal letters.
+    pub fn to_digits(&self, base: NumSystem) -> Vec<u8> {
+        let mut out = Vec::new();
+        self.write_digits(base, &mut out)
+            .expect("writing to a Vec cannot fail");
+        out
+    }
+
+    /// Hands the digits of the number in `base` to `sink`, in blocks as they become final.
+    ///
+    /// Besides the number itself, this holds at most the quotients and remainders along one
+    /// path of the power tree, about as much again, rather than the whole text.
+    pub(crate) fn write_digits(&self, base: NumSystem, sink: &mut dyn DigitSink) -> io::Result<()> {
+        if self.limbs.is_empty() {
+            sink.begin(1)?;
+            return sink.push(b"0");
+        }
+        match base {
+            NumSystem::Dec => {
+                let t = current_profile().mul;
+                let mut powers = Powers::new();
+                let level = powers.level_above(self.bits());
+                let limbs = Cow::Borrowed(self.limbs.as_slice());
+                let written = write_decimal(limbs, level, false, 0, &mut powers, t, sink);
+                powers.store();
+                written
+            }
+            _ => unpack_bits(&self.limbs, (base as u32).trailing_zeros(), sink),
+        }
+    }
+}
+
+impl From<u128> for BigUint {
+    fn from(value: u128) -> BigUint {
+        BigUint::from_limbs((0..4).map(|i| (value >> (32 * i)) as u32).collect())
+    }
+}
+
+/// Returns the number of significant bits of trimmed limbs.
+fn bit_len(limbs: &[u32]) -> u64 {
+    match limbs.last() {
+        Some(top) => limbs.len() as u64 * 32 - top.leading_zeros() as u64,
+        None => 0,
+    }
+}
+
+/// Strips the prefix and separators of `num` and returns the values of its digits.
+fn digit_values(
+    num: &[u8],
+    base: NumSystem,
+    separators: Separators,
+) -> Result<Vec<u8>, ConversionError> {
+    let mut rest = num;
+    if let [b'0', prefix, tail @ ..] = num {
+        let prefix_base = match prefix.to_ascii_lowercase() {
+            b'x' => Some(NumSystem::Hex),
+            b'o' => Some(NumSystem::Oct),
+            b'b' => Some(NumSystem::Bin),
+            _ => None,
+        };
+        match prefix_base {
+            Some(b) if b == base => rest = tail,
+            Some(_) => return Err(ConversionError::InvalidBase),
+            None => (),
+        }
+    }
+    let radix = base as u8;
+    let mut digits = Vec::with_capacity(rest.len());
+    for &b in rest {
+        let d = DIGIT_VALUES[b as usize];
+        if d < radix {
+            digits.push(d);
+        } else if !separators.contains(b) {
+            return Err(ConversionError::InvalidDigit(byte_char(b)));
+        }
+    }
+    Ok(digits)
+}
+
+/// Packs digits of `bits` bits each, most significant first, into limbs.
+fn pack_bits(digits: &[u8], bits: u32) -> Vec<u32> {
+    let mut limbs = Vec::with_capacity(digits.len() * bits as usize / 32 + 1);
+    let (mut acc, mut filled) = (0u64, 0);
+    for &d in digits.iter().rev() {
+        acc |= (d as u64) << filled;
+        filled += bits;
+        if filled >= 32 {
+            limbs.push(acc as u32);
+            acc >>= 32;
+            filled -= 32;
+        }
+    }
+    limbs.push(acc as u32);
+    limbs
+}
+
+/// Writes the digits of `bits` bits each, most significant first, to `sink`.
+fn unpack_bits(limbs: &[u32], bits: u32, sink: &mut dyn DigitSink) -> io::Result<()> {
+    const DIGITS: &[u8; 16] = b"0123456789ABCDEF";
+    let total = bit_len(limbs).max(1);
+    let count = total.div_ceil(bits as u64);
+    sink.begin(count)?;
+    let mut block = [0u8; SINK_BLOCK];
+    let mut filled = 0;
+    for i in (0..count).rev() {
+        let pos = i * bits as u64;
+        let limb = (pos / 32) as usize;
+        let window = limbs.get(limb).copied().unwrap_or(0) as u64
+            | ((limbs.get(limb + 1).copied().unwrap_or(0) as u64) << 32);
+        block[filled] = DIGITS[(window >> (pos % 32)) as usize & ((1 << bits) - 1)];
+        filled += 1;
+        if filled == SINK_BLOCK {
+            sink.push(&block)?;
+            filled = 0;
+        }
+    }
+    sink.push(&block[..filled])
+}
+
+/// The limbs of a power or reciprocal, computed or mapped from the power cache.
+enum Limbs {
+    Owned(Vec<u32>),
+    Cached(Arc<PowerTable>, Range<usize>),
+}
+
+impl Deref for Limbs {
+    type Target = [u32];
+
+    fn deref(&self) -> &[u32] {
+        match self {
+            Limbs::Owned(limbs) => limbs,
+            Limbs::Cached(table, range) => table.limbs(range.clone()),
+        }
+    }
+}
+
+/// The decimal power tree `10^(9 * 2^k)`, with reciprocals for fast division.
+pub(crate) struct Powers {
+    levels: Vec<Level>,
+    /// Whether levels or reciprocals were computed that the power cache lacks.
+    grown: bool,
+}
+
+struct Level {
+    power: Limbs,
+    reciprocal: Option<Limbs>,
+}
+
+impl Powers {
+    /// Returns the tree from the power cache if one is set, or just its leaf otherwise.
+    pub(crate) fn new() -> Powers {
+        let mut levels: Vec<Level> = match cached_powers(LEAF) {
+            Some(table) => table
+                .levels()
+                .iter()
+                .map(|(power, reciprocal)| Level {
+                    power: Limbs::Cached(table.clone(), power.clone()),
+                    reciprocal: reciprocal
+                        .clone()
+                        .map(|range| Limbs::Cached(table.clone(), range)),
+                })
+                .collect(),
+            None => Vec::new(),
+        };
+        if levels.is_empty() {
+            levels.push(Level {
+                power: Limbs::Owned(vec![LEAF]),
+                reciprocal: None,
+            });
+        }
+        Powers {
+            levels,
+            grown: false,
+        }
+    }
+
+    /// Writes the tree to the power cache if it has grown.
+    fn store(&self) {
+        if self.grown {
+            let levels: Vec<(&[u32], Option<&[u32]>)> = self
+                .levels
+                .iter()
+                .map(|level| (&*level.power, level.reciprocal.as_deref()))
+                .collect();
+            store_powers(LEAF, &levels);
+        }
+    }
+
+    /// Returns `10^(9 * 2^k)`, squaring lower levels as needed.
+    fn power(&mut self, k: usize, t: MulThresholds) -> &[u32] {
+        while self.levels.len() <= k {
+            let last = &self.levels.last().expect("leaf level").power;
+            let mut square = mul::mul(last, last, t);
+            trim(&mut square);
+            self.levels.push(Level {
+                power: Limbs::Owned(square),
+                reciprocal: None,
+            });
+            self.grown = true;
+        }
+        &self.levels[k].power
+    }
+
+    /// Returns the lowest level whose square exceeds every number of `bits` bits.
+    fn level_above(&mut self, bits: u64) -> usize {
+        // 10^(9 * 2^k) has more than 29.8 * 2^k bits.
+        let mut k = 0;
+        while 2 * 29 * (1u64 << k) < bits {
+            k += 1;
+        }
+        k
+    }
+
+    /// Divides `a`, which must be below the square of level `k`, by level `k`.
+    fn div_rem(&mut self, a: &[u32], k: usize, t: MulThresholds) -> (Vec<u32>, Vec<u32>) {
+        self.power(k, t);
+        let level = &mut self.levels[k];
+        if level.power.len() < NEWTON_MIN_LIMBS {
+            return div_rem_schoolbook(a, &level.power);
+        }
+        let power = &level.power;
+        let reciprocal = level.reciprocal.get_or_insert_with(|| {
+            self.grown = true;
+            Limbs::Owned(reciprocal(power, t))
+        });
+        div_rem_reciprocal(a, power, reciprocal, t)
+    }
+}
+
+/// Parses decimal digit values, most significant first, into limbs.
+fn parse_decimal(digits: &[u8], powers: &mut Powers, t: MulThresholds) -> Vec<u32> {
+    if digits.len() <= PARSE_BASE_DIGITS {
+        let mut limbs = Vec::with_capacity(digits.len() / LEAF_DIGITS + 1);
+        let head = digits.len() % LEAF_DIGITS;
+        let chunks = std::iter::once(&digits[..head]).chain(digits[head..].chunks(LEAF_DIGITS));
+        for chunk in chunks.filter(|c| !c.is_empty()) {
+            let value = chunk.iter().fold(0u32, |v, &d| v * 10 + d as u32);
+            mul_small_add(&mut limbs, 10u32.pow(chunk.len() as u32), value);
+        }
+        return limbs;
+    }
+    // Split off the largest power-tree leaf count that leaves a non-empty high part.
+    let mut k = 0;
+    while LEAF_DIGITS << (k + 1) < digits.len() {
+        k += 1;
+    }
+    let (high, low) = digits.split_at(digits.len() - (LEAF_DIGITS << k));
+    let high = parse_decimal(high, powers, t);
+    let low = parse_decimal(low, powers, t);
+    let mut value = mul::mul(&high, powers.power(k, t), t);
+    value.push(0);
+    add_into(&mut value, &low);
+    trim(&mut value);
+    value
+}
+
+/// Writes the decimal digits of `a`, which must be below the square of level `k`, to `sink`.
+///
+/// With `pad` the output is zero-padded to exactly `9 * 2^(k + 1)` digits, as needed for the
+/// lower half of a split; otherwise leading zeros are omitted and zero writes nothing. The
+/// leading, unpadded part begins the sink with its own length plus `after`, the number of
+/// padded digits that follow it. Owned values are freed as soon as they are split.
+fn write_decimal(
+    a: Cow<[u32]>,
+    k: usize,
+    pad: bool,
+    after: u64,
+    powers: &mut Powers,
+    t: MulThresholds,
+    sink: &mut dyn DigitSink,
+) -> io::Result<()> {
+    let limbs = trimmed(&a);
+    if limbs.len() <= FORMAT_BASE_LIMBS {
+        let digits = write_decimal_small(limbs);
+        if !pad {
+            sink.begin(digits.len() as u64 + after)?;
+        } else {
+            // The low half of a split may be far shorter than its width, down to zero for
+            // powers of ten, so the padding goes out in blocks rather than in one buffer.
+            let width = (LEAF_DIGITS << (k + 1)) as u64;
+            let mut zeros = width.saturating_sub(digits.len() as u64);
+            while zeros > 0 {
+                let n = zeros.min(SINK_BLOCK as u64) as usize;
+                sink.push(&[b'0'; SINK_BLOCK][..n])?;
+                zeros -= n as u64;
+            }
+        }
+        return sink.push(&digits);
+    }
+    let (high, low) = powers.div_rem(limbs, k, t);
+    drop(a);
+    if !pad && trimmed(&high).is_empty() {
+        return write_decimal(Cow::Owned(low), k - 1, pad, after, powers, t, sink);
+    }
+    let low_digits = (LEAF_DIGITS << k) as u64;
+    write_decimal(
+        Cow::Owned(high),
+        k - 1,
+        pad,
+        after + low_digits,
+        powers,
+        t,
+        sink,
+    )?;
+    write_decimal(Cow::Owned(low), k - 1, true, after, powers, t, sink)
+}
+
+/// Returns the decimal digits of a short number by repeated division; zero has none.
+fn write_decimal_small(a: &[u32]) -> Vec<u8> {
+    let mut rest = a.to_vec();
+    let mut leaves = Vec::new();
+    while !rest.is_empty() {
+        leaves.push(div_small(&mut rest, LEAF));
+    }
+    let mut digits = Vec::with_capacity(leaves.len() * LEAF_DIGITS);
+    for (i, leaf) in leaves.iter().rev().enumerate() {
+        let text = match i {
+            0 => leaf.to_string(),
+            _ => format!("{:09}", leaf),
+        };
+        digits.extend_from_slice(text.as_bytes());
+    }
+    digits
+}
+
+/// Sets `limbs` to `limbs * factor + addend`.
+fn mul_small_add(limbs: &mut Vec<u32>, factor: u32, addend: u32) {
+    let mut carry = addend as u64;
+    for limb in limbs.iter_mut() {
+        let t = *limb as u64 * factor as u64 + carry;
+        *limb = t as u32;
+        carry = t >> 32;
+    }
+    if carry > 0 {
+        limbs.push(carry as u32);
+    }
+}
+
+/// Divides `limbs` in place by `divisor` and returns the remainder.
+fn div_small(limbs: &mut Vec<u32>, divisor: u32) -> u32 {
+    let mut rem = 0u64;
+    for limb in limbs.iter_mut().rev() {
+        let cur = (rem << 32) | *limb as u64;
+        *limb = (cur / divisor as u64) as u32;
+        rem = cur % divisor as u64;
+    }
+    trim(limbs);
+    rem as u32
+}
+
+/// Shifts limbs left by `shift < 32` bits into a vector one limb longer.
+fn shl_bits(a: &[u32], shift: u32) -> Vec<u32> {
+    let mut out = Vec::with_capacity(a.len() + 1);
+    let mut carry = 0u32;
+    for &x in a {
+        out.push((x << shift) | carry);
+        carry = if shift == 0 { 0 } else { x >> (32 - shift) };
+    }
+    out.push(carry);
+    out
+}
+
+/// Divides by Knuth's algorithm D.
+///
+/// # Returns
+/// The quotient and remainder, without leading zeros.
+fn div_rem_schoolbook(a: &[u32], d: &[u32]) -> (Vec<u32>, Vec<u32>) {
+    let (a, d) = (trimmed(a), trimmed(d));
+    assert!(!d.is_empty(), "division by zero");
+    if cmp(a, d) == Ordering::Less {
+        return (Vec::new(), a.to_vec());
+    }
+    if d.len() == 1 {
+        let mut q = a.to_vec();
+        let r = div_small(&mut q, d[0]);
+        return (q, BigUint::from(r as u128).limbs);
+    }
+
+    // Normalize so the divisor's top bit is set, which bounds the quotient estimates.
+    let shift = d[d.len() - 1].leading_zeros();
+    let mut d = shl_bits(d, shift);
+    d.pop();
+    let mut u = shl_bits(a, shift);
+    let n = d.len();
+    let (top, next) = (d[n - 1] as u64, d[n - 2] as u64);
+    let mut q = vec![0u32; u.len() - n];
+    for j in (0..u.len() - n).rev() {
+        let num = ((u[j + n] as u64) << 32) | u[j + n - 1] as u64;
+        let (mut qhat, mut rhat) = (num / top, num % top);
+        while qhat >> 32 != 0 || qhat * next > ((rhat << 32) | u[j + n - 2] as u64) {
+            qhat -= 1;
+            rhat += top;
+            if rhat >> 32 != 0 {
+                break;
+            }
+        }
+
+        let (mut borrow, mut carry) = (0i64, 0u64);
+        for i in 0..n {
+            let p = qhat * d[i] as u64 + carry;
+            carry = p >> 32;
+            let t = u[i + j] as i64 - borrow - (p & 0xFFFF_FFFF) as i64;
+            u[i + j] = t as u32;
+            borrow = (t < 0) as i64;
+        }
+        let t = u[j + n] as i64 - borrow - carry as i64;
+        u[j + n] = t as u32;
+        if t < 0 {
+            // The estimate was one too large: add the divisor back.
+            qhat -= 1;
+            let mut carry = 0u64;
+            for i in 0..n {
+                let s = u[i + j] as u64 + d[i] as u64 + carry;
+                u[i + j] = s as u32;
+                carry = s >> 32;
+            }
+            u[j + n] = u[j + n].wrapping_add(carry as u32);
+        }
+        q[j] = qhat as u32;
+    }
+
+    let mut r: Vec<u32> = (0..n)
+        .map(|i| match shift {
+            0 => u[i],
+            s => (u[i] >> s) | (u[i + 1] << (32 - s)),
+        })
+        .collect();
+    trim(&mut q);
+    trim(&mut r);
+    (q, r)
+}
+
+/// Returns `floor(B^(2n) / d)` for `d` of `n` limbs, give or take a few units, where `B` is
+/// the limb base.
+///
+/// Each Newton step doubles the precision of the reciprocal of the top half of `d`.
+fn reciprocal(d: &[u32], t: MulThresholds) -> Vec<u32> {
+    let n = d.len();
+    let mut one = vec![0u32; 2 * n + 1];
+    one[2 * n] = 1;
+    if n < NEWTON_MIN_LIMBS {
+        return div_rem_schoolbook(&one, d).0;
+    }
+
+    let h = n / 2 + 2;
+    let mut x = vec![0u32; n - h];
+    x.extend(reciprocal(&d[n - h..], t));
+
+    let mut dx = mul::mul(d, &x, t);
+    trim(&mut dx);
+    let too_small = cmp(&dx, &one) != Ordering::Greater;
+    let error = if too_small {
+        sub_into(&mut one, &dx);
+        one
+    } else {
+        sub_into(&mut dx, &one);
+        dx
+    };
+    let correction = mul::mul(&x, trimmed(&error), t);
+    let correction = trimmed(correction.get(2 * n..).unwrap_or_default());
+    if too_small {
+        x.push(0);
+        add_into(&mut x, correction);
+    } else {
+        sub_into(&mut x, correction);
+        sub_into(&mut x, &[1]);
+    }
+    trim(&mut x);
+    x
+}
+
+/// Divides `a < B^(2n)` by `d` of `n` limbs using its [`reciprocal`].
+fn div_rem_reciprocal(
+    a: &[u32],
+    d: &[u32],
+    reciprocal: &[u32],
+    t: MulThresholds,
+) -> (Vec<u32>, Vec<u32>) {
+    let a = trimmed(a);
+    let product = mul::mul(a, reciprocal, t);
+    let mut q = trimmed(product.get(2 * d.len()..).unwrap_or_default()).to_vec();
+    let mut qd = mul::mul(&q, d, t);
+    trim(&mut qd);
+    // The estimate is off by a few units either way; step it to the exact quotient.
+    while cmp(&qd, a) == Ordering::Greater {
+        sub_into(&mut q, &[1]);
+        sub_into(&mut qd, d);
+    }
+    let mut r = a.to_vec();
+    sub_into(&mut r, &qd);
+    trim(&mut r);
+    while cmp(&r, d) != Ordering::Less {
+        sub_into(&mut r, d);
+        q.push(0);
+        add_into(&mut q, &[1]);
+    }
+    trim(&mut q);
+    trim(&mut r);
+    (q, r)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::format_value;
+    use crate::testing::XorShift;
+
+    fn random_digits(len: usize, base: NumSystem, seed: u64) -> Vec<u8> {
+        const DIGITS: &[u8; 16] = b"0123456789ABCDEF";
+        let mut rng = XorShift::new(seed);
+        let mut digits: Vec<u8> = (0..len)
+            .map(|_| DIGITS[(rng.next_u64() % base as u64) as usize])
+            .collect();
+        if let Some(first) = digits.first_mut() {
+            *first = b'1';
+        }
+        digits
+    }
+
+    #[test]
+    fn small_numbers_match_the_u128_path() {
+        let bases = [
+            NumSystem::Bin,
+            NumSystem::Oct,
+            NumSystem::Dec,
+            NumSystem::Hex,
+        ];
+        for value in [
+            0,
+            1,
+            9,
+            10,
+            999_999_999,
+            1_000_000_000,
+            u64::MAX as u128,
+            u128::MAX,
+        ] {
+            for src in bases {
+                let text = format_value(value, src);
+                let big = BigUint::parse(text.as_bytes(), src, Separators::none()).unwrap();
+                assert_eq!(big, BigUint::from(value));
+                for tgt in bases {
+                    assert_eq!(big.to_digits(tgt), format_value(value, tgt).as_bytes());
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn long_numbers_round_trip_between_decimal_and_hex() {
+        for len in [300, 1000, 4321, 30_000] {
+            let decimal = random_digits(len, NumSystem::Dec, len as u64);
+            let big = BigUint::parse(&decimal, NumSystem::Dec, Separators::none()).unwrap();
+            let hex = big.to_digits(NumSystem::Hex);
+            let again = BigUint::parse(&hex, NumSystem::Hex, Separators::none()).unwrap();
+            assert_eq!(again, big);
+            assert_eq!(again.to_digits(NumSystem::Dec), decimal, "{} digits", len);
+        }
+    }
+
+    #[test]
+    fn powers_of_ten_format_with_every_zero() {
+        for exp in [9, 288, 289, 5000] {
+            let mut text = vec![b'1'];
+            text.resize(exp + 1, b'0');
+            let big = BigUint::parse(&text, NumSystem::Dec, Separators::none()).unwrap();
+            assert_eq!(big.to_digits(NumSystem::Dec), text);
+            let mut below = big.limbs().to_vec();
+            sub_into(&mut below, &[1]);
+            let nines = BigUint::from_limbs(below).to_digits(NumSystem::Dec);
+            assert_eq!(nines, vec![b'9'; exp]);
+        }
+    }
+
+    #[test]
+    fn division_matches_schoolbook() {
+        let t = MulThresholds::default();
+        let d = BigUint::parse(
+            &random_digits(2000, NumSystem::Hex, 7),
+            NumSystem::Hex,
+            Separators::none(),
+        )
+        .unwrap();
+        let a = BigUint::parse(
+            &random_digits(3990, NumSystem::Hex, 11),
+            NumSystem::Hex,
+            Separators::none(),
+        )
+        .unwrap();
+        let r = reciprocal(d.limbs(), t);
+        assert_eq!(
+            div_rem_reciprocal(a.limbs(), d.limbs(), &r, t),
+            div_rem_schoolbook(a.limbs(), d.limbs())
+        );
+    }
+
+    #[test]
+    fn parse_follows_the_parser_rules() {
+        let parse = |s: &str, base| BigUint::parse(s.as_bytes(), base, Separators::new(b"_"));
+        assert_eq!(parse("0x_ff", NumSystem::Hex), Ok(BigUint::from(255)));
+        assert_eq!(parse("", NumSystem::Dec), Ok(BigUint::default()));
+        assert_eq!(
+            parse("0b1", NumSystem::Hex),
+            Err(ConversionError::InvalidBase)
+        );
+        assert_eq!(
+            parse("12a", NumSystem::Dec),
+            Err(ConversionError::InvalidDigit('a'))
+        );
+    }
+
+    #[test]
+    fn zero_padding_is_written_in_blocks() {
+        /// Keeps the digits and the size of the largest block.
+        struct Blocks(Vec<u8>, usize);
+
+        impl DigitSink for Blocks {
+            fn begin(&mut self, _: u64) -> io::Result<()> {
+                Ok(())
+            }
+
+            fn push(&mut self, digits: &[u8]) -> io::Result<()> {
+                self.1 = self.1.max(digits.len());
+                self.0.extend_from_slice(digits);
+                Ok(())
+            }
+        }
+
+        // The lower half of every split of a power of ten is zero.
+        let mut decimal = vec![b'0'; 40_001];
+        decimal[0] = b'1';
+        let big = BigUint::parse(&decimal, NumSystem::Dec, Separators::none()).unwrap();
+        let mut sink = Blocks(Vec::new(), 0);
+        big.write_digits(NumSystem::Dec, &mut sink).unwrap();
+        assert!(sink.0 == decimal);
+        assert!(sink.1 <= SINK_BLOCK, "block of {} digits", sink.1);
+    }
+}
@@ -0,0 +1,187 @@
+//! A memory budget shared by the stages of batch conversions.
+//!
+//! The reader charges every chunk's estimated memory to the [`Budget`] before handing it to
+//! the workers, and the writer releases the charge once the chunk's output is written. When
+//! the budget is used up the reader blocks, so a slow chunk cannot make the reorder queue
+//! grow without bound. Several conversions can share one budget, each through its own
+//! [`Charges`].
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::{Condvar, Mutex};
+
+#[derive(Debug, Default)]
+struct Usage {
+    used: usize,
+    peak: usize,
+    /// The number of charged chunks that have not been released yet.
+    chunks: usize,
+}
+
+/// Tracks memory held by batch conversions against an upper limit.
+#[derive(Debug)]
+pub(crate) struct Budget {
+    limit: usize,
+    usage: Mutex<Usage>,
+    released: Condvar,
+}
+
+impl Budget {
+    /// Creates a budget of `limit` bytes; 0 means unlimited, with usage still tracked.
+    pub(crate) fn new(limit: usize) -> Budget {
+        Budget {
+            limit: match limit {
+                0 => usize::MAX,
+                n => n,
+            },
+            usage: Mutex::new(Usage::default()),
+            released: Condvar::new(),
+        }
+    }
+
+    /// Returns a tally of charges for one conversion, released when it is dropped.
+    pub(crate) fn charges(&self) -> Charges<'_> {
+        Charges {
+            budget: self,
+            chunks: AtomicUsize::new(0),
+            bytes: AtomicUsize::new(0),
+            closed: AtomicBool::new(false),
+        }
+    }
+
+    /// Returns the most memory that was charged at once.
+    pub(crate) fn peak(&self) -> usize {
+        self.usage.lock().expect("budget poisoned").peak
+    }
+
+    fn change(&self, chunks: isize, bytes: isize) {
+        let mut usage = self.usage.lock().expect("budget poisoned");
+        usage.chunks = usage.chunks.wrapping_add_signed(chunks);
+        usage.used = usage.used.wrapping_add_signed(bytes);
+        usage.peak = usage.peak.max(usage.used);
+        if bytes < 0 {
+            self.released.notify_all();
+        }
+    }
+}
+
+/// The part of a [`Budget`] charged by one conversion.
+pub(crate) struct Charges<'a> {
+    budget: &'a Budget,
+    chunks: AtomicUsize,
+    bytes: AtomicUsize,
+    closed: AtomicBool,
+}
+
+impl Charges<'_> {
+    /// Charges a chunk of `bytes`, blocking while that would exceed the limit.
+    ///
+    /// A chunk is always admitted when no other chunk is charged, so a single chunk larger
+    /// than the whole budget still makes progress.
+    ///
+    /// # Returns
+    /// `false` without charging anything if [`Charges::close`] was called.
+    pub(crate) fn acquire(&self, bytes: usize) -> bool {
+        let budget = self.budget;
+        let mut usage = budget.usage.lock().expect("budget poisoned");
+        loop {
+            if self.closed.load(Ordering::Relaxed) {
+                return false;
+            }
+            if usage.chunks == 0 || usage.used.saturating_add(bytes) <= budget.limit {
+                break;
+            }
+            usage = budget.released.wait(usage).expect("budget poisoned");
+        }
+        usage.chunks += 1;
+        usage.used += bytes;
+        usage.peak = usage.peak.max(usage.used);
+        self.chunks.fetch_add(1, Ordering::Relaxed);
+        self.bytes.fetch_add(bytes, Ordering::Relaxed);
+        true
+    }
+
+    /// Releases a chunk charged by [`Charges::acquire`].
+    pub(crate) fn release(&self, bytes: usize) {
+        self.chunks.fetch_sub(1, Ordering::Relaxed);
+        self.bytes.fetch_sub(bytes, Ordering::Relaxed);
+        self.budget.change(-1, -(bytes as isize));
+    }
+
+    /// Charges memory that is held regardless of the limit, such as buffer pools.
+    pub(crate) fn hold(&self, bytes: usize) {
+        self.bytes.fetch_add(bytes, Ordering::Relaxed);
+        self.budget.change(0, bytes as isize);
+    }
+
+    /// Releases memory charged by [`Charges::hold`].
+    pub(crate) fn unhold(&self, bytes: usize) {
+        self.bytes.fetch_sub(bytes, Ordering::Relaxed);
+        self.budget.change(0, -(bytes as isize));
+    }
+
+    /// Stops charging: pending and later calls to [`Charges::acquire`] return `false`.
+    pub(crate) fn close(&self) {
+        let _usage = self.budget.usage.lock().expect("budget poisoned");
+        self.closed.store(true, Ordering::Relaxed);
+        self.budget.released.notify_all();
+    }
+}
+
+impl Drop for Charges<'_> {
+    fn drop(&mut self) {
+        let chunks = *self.chunks.get_mut() as isize;
+        let bytes = *self.bytes.get_mut() as isize;
+        self.budget.change(-chunks, -bytes);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn acquire_blocks_until_enough_is_released() {
+        let budget = Budget::new(100);
+        let charges = budget.charges();
+        charges.acquire(60);
+        charges.acquire(40);
+        let admitted = AtomicBool::new(false);
+        std::thread::scope(|s| {
+            s.spawn(|| {
+                assert!(charges.acquire(30));
+                admitted.store(true, Ordering::SeqCst);
+            });
+            std::thread::sleep(std::time::Duration::from_millis(50));
+            assert!(!admitted.load(Ordering::SeqCst));
+            charges.release(60);
+        });
+        assert!(admitted.load(Ordering::SeqCst));
+        assert_eq!(budget.peak(), 100);
+    }
+
+    #[test]
+    fn an_oversized_chunk_is_admitted_alone() {
+        let budget = Budget::new(10);
+        let charges = budget.charges();
+        charges.hold(8);
+        assert!(charges.acquire(1000));
+        assert_eq!(budget.peak(), 1008);
+    }
+
+    #[test]
+    fn closing_wakes_a_blocked_reader_and_dropping_releases_everything() {
+        let budget = Budget::new(10);
+        {
+            let charges = budget.charges();
+            charges.hold(4);
+            charges.acquire(6);
+            std::thread::scope(|s| {
+                let blocked = s.spawn(|| charges.acquire(5));
+                std::thread::sleep(std::time::Duration::from_millis(50));
+                charges.close();
+                assert!(!blocked.join().unwrap());
+            });
+        }
+        let usage = budget.usage.lock().unwrap();
+        assert_eq!((usage.used, usage.chunks, usage.peak), (0, 0, 10));
+    }
+}
@@ -0,0 +1,241 @@
+//! Validation-only scanning of number files.
+//!
+//! [`check`] runs the digit-validation and overflow rules of [`convert_base`](crate::convert_base)
+//! over every whitespace-separated token of an input without formatting anything. Power-of-two
+//! bases use a multiplication-free kernel that only counts significant bits; decimal tokens
+//! go through the chunked [`Parser`](crate::Parser). Large inputs are split across threads.
+use crate::input::{map_parts, tokens};
+use crate::parser::{byte_char, DIGIT_VALUES};
+use crate::{ConversionError, NumSystem, Parser};
+
+/// Configuration for a validation run.
+pub struct CheckConfig {
+    /// The number system every token must be written in.
+    pub src_base: NumSystem,
+    /// The maximum width of a valid value in bits (1 to 128).
+    pub bits: u32,
+    /// The maximum number of errors to record.
+    pub max_errors: usize,
+    /// The number of worker threads (0 to use all available cores).
+    pub threads: usize,
+}
+
+impl CheckConfig {
+    pub fn new(src_base: NumSystem, bits: u32, max_errors: usize, threads: usize) -> CheckConfig {
+        CheckConfig {
+            src_base,
+            bits,
+            max_errors,
+            threads,
+        }
+    }
+}
+
+/// An invalid token found by [`check`].
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct TokenError {
+    /// The byte offset of the token in the input.
+    pub offset: usize,
+    /// Why the token is invalid.
+    pub error: ConversionError,
+}
+
+/// The result of a validation run.
+#[derive(Debug, Default, PartialEq)]
+pub struct CheckReport {
+    /// The number of valid tokens.
+    pub valid: usize,
+    /// The number of invalid tokens.
+    pub invalid: usize,
+    /// The first invalid tokens in input order, at most `max_errors` of them.
+    pub errors: Vec<TokenError>,
+}
+
+impl CheckReport {
+    /// Appends the report for the input that directly follows this one.
+    fn merge(&mut self, other: CheckReport, max_errors: usize) {
+        self.valid += other.valid;
+        self.invalid += other.invalid;
+        let room = max_errors.saturating_sub(self.errors.len());
+        self.errors.extend(other.errors.into_iter().take(room));
+    }
+}
+
+/// Checks that a single token is a valid number of at most `bits` bits.
+///
+/// # Arguments
+/// * `token` - The token, with an optional prefix matching `src`.
+/// * `src` - The number system the token must be written in.
+/// * `bits` - The maximum width of the value in bits.
+///
+/// # Returns
+/// * `Ok(())` - If the token is valid.
+/// * `Err(ConversionError)` - The error [`convert_base`](crate::convert_base) would report,
+///   with values wider than `bits` reported as [`ConversionError::NumberOverflow`].
+pub fn check_token(token: &[u8], src: NumSystem, bits: u32) -> Result<(), ConversionError> {
+    let shift = match src {
+        NumSystem::Bin => 1,
+        NumSystem::Oct => 3,
+        NumSystem::Hex => 4,
+        NumSystem::Dec => {
+            let mut parser = Parser::new(src);
+            parser.feed(token)?;
+            let value = parser.finish()?;
+            return match bits {
+                128.. => Ok(()),
+                _ if value >> bits == 0 => Ok(()),
+                _ => Err(ConversionError::NumberOverflow),
+            };
+        }
+    };
+
+    let digits = match token {
+        [b'0', p, rest @ ..] if matches!(p.to_ascii_lowercase(), b'x' | b'o' | b'b') => {
+            let prefix_base = match p.to_ascii_lowercase() {
+                b'x' => NumSystem::Hex,
+                b'o' => NumSystem::Oct,
+                _ => NumSystem::Bin,
+            };
+            if prefix_base != src {
+                return Err(ConversionError::InvalidBase);
+            }
+            rest
+        }
+        _ => token,
+    };
+
+    // The width of the value is fixed by its first non-zero digit and the number of digits
+    // after it, so no arithmetic on the value itself is needed.
+    let base = src as u8;
+    let mut used = 0u32;
+    for &b in digits {
+        let d = DIGIT_VALUES[b as usize];
+        if d >= base {
+            return Err(ConversionError::InvalidDigit(byte_char(b)));
+        }
+        if used != 0 {
+            used += shift;
+        } else {
+            used = u8::BITS - d.leading_zeros();
+        }
+        if used > bits {
+            return Err(ConversionError::NumberOverflow);
+        }
+    }
+
+    Ok(())
+}
+
+fn check_range(data: &[u8], base_offset: usize, config: &CheckConfig) -> CheckReport {
+    let mut report = CheckReport::default();
+    for (offset, token) in tokens(data) {
+        match check_token(token, config.src_base, config.bits) {
+            Ok(()) => report.valid += 1,
+            Err(error) => {
+                report.invalid += 1;
+                if report.errors.len() < config.max_errors {
+                    report.errors.push(TokenError {
+                        offset: base_offset + offset,
+                        error,
+                    });
+                }
+            }
+        }
+    }
+    report
+}
+
+/// Validates every whitespace-separated token of `data`.
+///
+/// # Arguments
+/// * `data` - The input, typically a memory-mapped file.
+/// * `config` - The validation rules and the degree of parallelism.
+///
+/// # Returns
+/// The number of valid and invalid tokens and the first `config.max_errors` errors.
+///
+/// # Examples
+///
+/// ```
+/// use nconv::{check, CheckConfig, NumSystem};
+///
+/// let report = check(b"0xFF 0x1FF 0xZZ", &CheckConfig::new(NumSystem::Hex, 8, 10, 1));
+/// assert_eq!(report.valid, 1);
+/// assert_eq!(report.invalid, 2);
+/// assert_eq!(report.errors[0].offset, 5);
+/// ```
+pub fn check(data: &[u8], config: &CheckConfig) -> CheckReport {
+    let threads = crate::worker_threads(config.threads);
+    let reports = map_parts(data, threads, |part, offset| {
+        check_range(part, offset, config)
+    });
+    let mut report = CheckReport::default();
+    for part in reports {
+        report.merge(part, config.max_errors);
+    }
+    report
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::input::PARALLEL_MIN_BYTES;
+
+    #[test]
+    fn check_token_agrees_with_parser_for_power_of_two_bases() {
+        let samples = [
+            "0", "0x0", "0xFF", "0x100", "0xG1", "0b101", "0b2", "0o17", "0o8", "0x", "FFFF",
+            "0001", "1FFFF", "0b1", "12 3",
+        ];
+        for src in [NumSystem::Bin, NumSystem::Oct, NumSystem::Hex] {
+            for sample in samples {
+                let expected = crate::parse_value(sample, src).and_then(|v| match v >> 16 {
+                    0 => Ok(()),
+                    _ => Err(ConversionError::NumberOverflow),
+                });
+                assert_eq!(
+                    check_token(sample.as_bytes(), src, 16),
+                    expected,
+                    "{:?} in {:?}",
+                    sample,
+                    src
+                );
+            }
+        }
+    }
+
+    #[test]
+    fn check_token_enforces_bit_width() {
+        assert!(check_token(b"255", NumSystem::Dec, 8).is_ok());
+        assert_eq!(
+            check_token(b"256", NumSystem::Dec, 8),
+            Err(ConversionError::NumberOverflow)
+        );
+        assert!(check_token(b"0b0001", NumSystem::Bin, 1).is_ok());
+        assert!(check_token("F".repeat(32).as_bytes(), NumSystem::Hex, 128).is_ok());
+        assert_eq!(
+            check_token("F".repeat(33).as_bytes(), NumSystem::Hex, 128),
+            Err(ConversionError::NumberOverflow)
+        );
+    }
+
+    #[test]
+    fn check_parallel_matches_single_threaded() {
+        let mut data = Vec::new();
+        for i in 0..300_000u32 {
+            let token = if i % 997 == 0 {
+                format!("{:x}z ", i)
+            } else {
+                format!("{:x} ", i)
+            };
+            data.extend_from_slice(token.as_bytes());
+        }
+        assert!(data.len() >= PARALLEL_MIN_BYTES);
+
+        let serial = check(&data, &CheckConfig::new(NumSystem::Hex, 32, 5, 1));
+        let parallel = check(&data, &CheckConfig::new(NumSystem::Hex, 32, 5, 4));
+        assert_eq!(serial, parallel);
+        assert_eq!(serial.invalid, 301);
+        assert_eq!(serial.errors.len(), 5);
+    }
+}
@@ -0,0 +1,221 @@
+//! Checkpoints for resuming batch conversions of large files.
+//!
+//! A [`Checkpoint`] records how far a conversion got: every number before `input_offset` has
+//! been converted, and its output makes up the first `output_len` bytes of the output file,
+//! which were synced to disk before the checkpoint was stored. Resuming truncates the output
+//! to that length and continues reading at `input_offset`. The checkpoint also records the
+//! [`OutputLayout`] of the conversion, so that a resumed run cannot append output in
+//! another format.
+use crate::{ConversionPlan, Separators};
+use std::fmt::Display;
+use std::io::{self, Write};
+use std::path::Path;
+use std::time::{Duration, Instant};
+
+/// How often the writer syncs the output and stores a checkpoint.
+pub const CHECKPOINT_INTERVAL: Duration = Duration::from_secs(5);
+
+const HEADER: &str = "nconv checkpoint 2";
+
+/// The settings of a conversion that decide what its output looks like.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct OutputLayout {
+    /// The radix of the source number system.
+    pub src_radix: u32,
+    /// The radix of the target number system.
+    pub tgt_radix: u32,
+    /// The minimum width for zero-padding the output.
+    pub width: u32,
+    /// The size of digit grouping (0 for no grouping).
+    pub grouping: u32,
+    /// Bytes skipped between the digits of input numbers.
+    pub separators: Separators,
+}
+
+impl OutputLayout {
+    /// Returns the layout of the output of `plan`.
+    pub fn of(plan: &ConversionPlan) -> OutputLayout {
+        OutputLayout {
+            src_radix: plan.src_base as u32,
+            tgt_radix: plan.tgt_base as u32,
+            width: plan.width,
+            grouping: plan.grouping,
+            separators: plan.separators,
+        }
+    }
+}
+
+/// The progress of a batch conversion.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct Checkpoint {
+    /// The size of the input file, to detect a different or changed input on resume.
+    pub input_len: u64,
+    /// The input offset up to which every number has been converted.
+    pub input_offset: u64,
+    /// The length of the output written for the input before `input_offset`.
+    pub output_len: u64,
+    /// The conversion settings the output was written with.
+    pub layout: OutputLayout,
+}
+
+impl Checkpoint {
+    /// Reads a checkpoint stored by [`Checkpoint::store`].
+    pub fn load(path: &Path) -> io::Result<Checkpoint> {
+        let text = std::fs::read_to_string(path)?;
+        let invalid = || {
+            io::Error::new(
+                io::ErrorKind::InvalidData,
+                format!("{}: not an nconv checkpoint", path.display()),
+            )
+        };
+        let mut lines = text.lines();
+        if lines.next() != Some(HEADER) {
+            return Err(invalid());
+        }
+        let mut field = |name: &str| -> io::Result<u64> {
+            lines
+                .next()
+                .and_then(|line| line.strip_prefix(name)?.strip_prefix(' ')?.parse().ok())
+                .ok_or_else(invalid)
+        };
+        let mut checkpoint = Checkpoint {
+            input_len: field("input_len")?,
+            input_offset: field("input_offset")?,
+            output_len: field("output_len")?,
+            ..Checkpoint::default()
+        };
+        // The separators are stored as the hex codes of their bytes, or "-" for none.
+        let layout = lines.next().and_then(|line| line.strip_prefix("layout "));
+        let fields: Vec<&str> = layout.ok_or_else(invalid)?.split(' ').collect();
+        let [src, tgt, width, grouping, separators] = fields[..] else {
+            return Err(invalid());
+        };
+        let number = |s: &str| s.parse::<u32>().map_err(|_| invalid());
+        let separators = match separators {
+            "-" => Vec::new(),
+            hex => (0..hex.len() / 2)
+                .map(|i| u8::from_str_radix(hex.get(2 * i..2 * i + 2).unwrap_or("?"), 16))
+                .collect::<Result<_, _>>()
+                .map_err(|_| invalid())?,
+        };
+        checkpoint.layout = OutputLayout {
+            src_radix: number(src)?,
+            tgt_radix: number(tgt)?,
+            width: number(width)?,
+            grouping: number(grouping)?,
+            separators: Separators::new(&separators),
+        };
+        Ok(checkpoint)
+    }
+
+    /// Stores the checkpoint at `path`, atomically replacing any previous one.
+    pub fn store(&self, path: &Path) -> io::Result<()> {
+        let mut tmp = path.as_os_str().to_owned();
+        tmp.push(".tmp");
+        let mut file = std::fs::File::create(&tmp)?;
+        write!(file, "{}", self)?;
+        file.sync_data()?;
+        std::fs::rename(&tmp, path)
+    }
+}
+
+impl Display for Checkpoint {
+    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+        writeln!(f, "{}", HEADER)?;
+        writeln!(f, "input_len {}", self.input_len)?;
+        writeln!(f, "input_offset {}", self.input_offset)?;
+        writeln!(f, "output_len {}", self.output_len)?;
+        let layout = &self.layout;
+        let separators: String = (0..128u8)
+            .filter(|&b| layout.separators.contains(b))
+            .map(|b| format!("{:02x}", b))
+            .collect();
+        writeln!(
+            f,
+            "layout {} {} {} {} {}",
+            layout.src_radix,
+            layout.tgt_radix,
+            layout.width,
+            layout.grouping,
+            if separators.is_empty() {
+                "-"
+            } else {
+                &separators
+            }
+        )
+    }
+}
+
+/// Tracks the progress of the writer and stores checkpoints at intervals.
+pub(crate) struct Checkpointer<'a> {
+    path: &'a Path,
+    progress: Checkpoint,
+    last: Instant,
+}
+
+impl<'a> Checkpointer<'a> {
+    /// Starts tracking from `progress`, the point the conversion starts or resumes at.
+    pub(crate) fn new(path: &'a Path, progress: Checkpoint) -> Checkpointer<'a> {
+        Checkpointer {
+            path,
+            progress,
+            last: Instant::now(),
+        }
+    }
+
+    /// Returns the progress recorded so far.
+    pub(crate) fn progress(&self) -> Checkpoint {
+        self.progress
+    }
+
+    /// Records that the input up to `input_offset` is converted into `output_len` more bytes.
+    ///
+    /// Returns whether a checkpoint is due; the caller then syncs the output and calls
+    /// [`Checkpointer::store`].
+    pub(crate) fn advance(&mut self, input_offset: u64, output_len: usize) -> bool {
+        self.progress.input_offset = input_offset;
+        self.progress.output_len += output_len as u64;
+        self.last.elapsed() >= CHECKPOINT_INTERVAL
+    }
+
+    /// Stores the current progress. The output must be synced up to it.
+    pub(crate) fn store(&mut self) -> io::Result<()> {
+        self.last = Instant::now();
+        self.progress.store(self.path)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn checkpoints_round_trip_and_reject_other_files() -> io::Result<()> {
+        let path = std::env::temp_dir().join(format!("nconv-ckpt-{}", std::process::id()));
+        let plan = ConversionPlan::new(
+            crate::NumSystem::Hex,
+            crate::NumSystem::Bin,
+            4,
+            16,
+            Separators::new(b" _"),
+        );
+        let mut checkpoint = Checkpoint {
+            input_len: 1 << 40,
+            input_offset: 123_456_789,
+            output_len: 98_765,
+            layout: OutputLayout::of(&plan),
+        };
+        checkpoint.store(&path)?;
+        assert_eq!(Checkpoint::load(&path)?, checkpoint);
+        checkpoint.layout = OutputLayout::default();
+        checkpoint.store(&path)?;
+        assert_eq!(Checkpoint::load(&path)?, checkpoint);
+
+        std::fs::write(&path, "ff\n10\n")?;
+        assert_eq!(
+            Checkpoint::load(&path).unwrap_err().kind(),
+            io::ErrorKind::InvalidData
+        );
+        std::fs::remove_file(&path)
+    }
+}
@@ -0,0 +1,244 @@
+//! Conversion of many files at once.
+//!
+//! [`convert_files`] spreads a list of [`FileJob`]s over a pool of threads. Each file is
+//! converted by [`convert_file`](crate::convert_file) exactly as in the single-file mode, into its own output.
+//! Files are handed out largest first, which keeps the threads evenly loaded when a few big
+//! files are mixed with many small ones.
+use crate::batch::convert_file_within;
+use crate::budget::Budget;
+use crate::{BatchConfig, BatchReport, TokenError};
+use std::collections::HashSet;
+use std::fmt::Display;
+use std::io;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+
+/// Prefixes the message of `e` with `path`.
+fn at(path: &Path, e: io::Error) -> io::Error {
+    io::Error::new(e.kind(), format!("{}: {}", path.display(), e))
+}
+
+/// One input file and where to write its converted numbers.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct FileJob {
+    /// The file to convert.
+    pub input: PathBuf,
+    /// The file to write the converted numbers to.
+    pub output: PathBuf,
+    /// The size of the input in bytes, used to schedule large files first.
+    pub size: u64,
+}
+
+impl FileJob {
+    /// Pairs every file in `inputs` with an output of the same name in `output_dir`.
+    ///
+    /// # Returns
+    /// * `Ok(Vec<FileJob>)` - One job per input, in the given order.
+    /// * `Err(io::Error)` - If an input cannot be read, is not a file, or two inputs share a
+    ///   name and would overwrite each other's output.
+    pub fn for_files(inputs: &[PathBuf], output_dir: &Path) -> io::Result<Vec<FileJob>> {
+        let mut names = HashSet::new();
+        let mut jobs = Vec::with_capacity(inputs.len());
+        for input in inputs {
+            let metadata = input.metadata().map_err(|e| at(input, e))?;
+            let name = match input.file_name() {
+                Some(name) if metadata.is_file() => name,
+                _ => {
+                    return Err(io::Error::new(
+                        io::ErrorKind::InvalidInput,
+                        format!("{}: not a file", input.display()),
+                    ))
+                }
+            };
+            if !names.insert(name) {
+                return Err(io::Error::new(
+                    io::ErrorKind::InvalidInput,
+                    format!(
+                        "{}: more than one input named {:?}",
+                        output_dir.display(),
+                        name
+                    ),
+                ));
+            }
+            jobs.push(FileJob {
+                input: input.clone(),
+                output: output_dir.join(name),
+                size: metadata.len(),
+            });
+        }
+        Ok(jobs)
+    }
+
+    /// Pairs every regular file directly in `input_dir` with an output of the same name in
+    /// `output_dir`. Subdirectories are not descended into.
+    pub fn for_directory(input_dir: &Path, output_dir: &Path) -> io::Result<Vec<FileJob>> {
+        let mut inputs = Vec::new();
+        for entry in std::fs::read_dir(input_dir).map_err(|e| at(input_dir, e))? {
+            let path = entry.map_err(|e| at(input_dir, e))?.path();
+            if path.is_file() {
+                inputs.push(path);
+            }
+        }
+        inputs.sort();
+        FileJob::for_files(&inputs, output_dir)
+    }
+}
+
+/// A problem with one file of a multi-file conversion.
+#[derive(Debug)]
+pub enum FileError {
+    /// A number in the file failed to convert.
+    Token(TokenError),
+    /// The file could not be read or its output could not be written.
+    Io(io::Error),
+}
+
+impl Display for FileError {
+    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+        match self {
+            FileError::Token(e) => write!(f, "byte {}: {}", e.offset, e.error),
+            FileError::Io(e) => write!(f, "{}", e),
+        }
+    }
+}
+
+/// Converts many files in parallel, each into its own output.
+///
+/// Every file is converted as by [`convert_file`](crate::convert_file) with `config`. The
+/// threads of `config` are shared out between the files: with more files than threads each
+/// file is converted by a single thread, otherwise the threads are split evenly among the
+/// files. `config.max_memory` is a single budget for all files at once.
+///
+/// # Arguments
+/// * `jobs` - The files to convert. Output directories must already exist.
+/// * `config` - The conversion plan, total parallelism and I/O backend.
+/// * `on_error` - Called, from any thread, for every failed number and every file that could
+///   not be converted. The errors of one file arrive in input order.
+///
+/// # Returns
+/// The combined report of all files. A file that could not be converted only counts towards
+/// `files_failed`.
+pub fn convert_files(
+    jobs: &[FileJob],
+    config: &BatchConfig,
+    on_error: &(dyn Fn(&Path, FileError) + Sync),
+) -> BatchReport {
+    let mut order: Vec<&FileJob> = jobs.iter().collect();
+    order.sort_by(|a, b| b.size.cmp(&a.size));
+
+    let threads = crate::worker_threads(config.threads);
+    let pool = threads.min(order.len());
+    let per_file = (threads / order.len().max(1)).max(1);
+    let next = AtomicUsize::new(0);
+    let total = Mutex::new(BatchReport::default());
+    let budget = Budget::new(config.max_memory);
+
+    std::thread::scope(|s| {
+        for _ in 0..pool {
+            s.spawn(|| loop {
+                let Some(job) = order.get(next.fetch_add(1, Ordering::Relaxed)) else {
+                    return;
+                };
+                let config = BatchConfig::new(
+                    config.plan,
+                    per_file,
+                    config.chunk_size,
+                    config.backend,
+                    // Rounded up, so that a budget smaller than the pool does not become 0,
+                    // which means no limit.
+                    config.max_memory.div_ceil(pool),
+                );
+                let mut report_error = |e| on_error(&job.input, FileError::Token(e));
+                let output = Some(job.output.as_path());
+                let report = convert_file_within(
+                    &job.input,
+                    output,
+                    &config,
+                    &budget,
+                    None,
+                    &mut report_error,
+                );
+                match report {
+                    Ok(report) => total.lock().expect("report poisoned").add(&report),
+                    Err(e) => {
+                        total.lock().expect("report poisoned").files_failed += 1;
+                        on_error(&job.input, FileError::Io(e));
+                    }
+                }
+            });
+        }
+    });
+
+    let mut total = total.into_inner().expect("report poisoned");
+    total.backend = total.backend.or(Some(config.backend));
+    total.peak_memory = budget.peak();
+    total
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{ConversionPlan, IoBackend, NumSystem, Separators, DEFAULT_CHUNK_SIZE};
+
+    #[test]
+    fn convert_files_matches_single_file_mode() {
+        let base = std::env::temp_dir().join(format!("nconv-files-{}", std::process::id()));
+        let (input_dir, output_dir) = (base.join("in"), base.join("out"));
+        std::fs::create_dir_all(&input_dir).unwrap();
+        std::fs::create_dir_all(&output_dir).unwrap();
+        std::fs::create_dir_all(input_dir.join("skipped")).unwrap();
+        for i in 0..20u32 {
+            let numbers: String = (0..i * 50).map(|n| format!("{:x} ", n * i)).collect();
+            std::fs::write(input_dir.join(format!("{}.txt", i)), numbers).unwrap();
+        }
+        std::fs::write(input_dir.join("bad.txt"), "ff zz 10").unwrap();
+
+        let jobs = FileJob::for_directory(&input_dir, &output_dir).unwrap();
+        assert_eq!(jobs.len(), 21);
+        let plan = ConversionPlan::new(NumSystem::Hex, NumSystem::Dec, 0, 1, Separators::none());
+        let config = BatchConfig::new(plan, 4, DEFAULT_CHUNK_SIZE, IoBackend::Mmap, 0);
+        let errors = Mutex::new(Vec::new());
+        let report = convert_files(&jobs, &config, &|path, e| {
+            errors
+                .lock()
+                .unwrap()
+                .push((path.to_path_buf(), e.to_string()))
+        });
+
+        assert_eq!(report.files, 21);
+        assert_eq!(report.files_failed, 0);
+        assert_eq!(report.failed, 1);
+        assert_eq!(
+            *errors.lock().unwrap(),
+            [(
+                input_dir.join("bad.txt"),
+                "byte 3: invalid digit: 'z'".to_string()
+            )]
+        );
+        for i in 0..20u32 {
+            let expected: String = (0..i * 50).map(|n| format!("{}\n", n * i)).collect();
+            let output = std::fs::read_to_string(output_dir.join(format!("{}.txt", i))).unwrap();
+            assert_eq!(output, expected);
+        }
+        std::fs::remove_dir_all(&base).unwrap();
+    }
+
+    #[test]
+    fn for_files_rejects_clashing_output_names() {
+        let base = std::env::temp_dir().join(format!("nconv-files-clash-{}", std::process::id()));
+        for dir in ["a", "b"] {
+            std::fs::create_dir_all(base.join(dir)).unwrap();
+            std::fs::write(base.join(dir).join("x.txt"), "1").unwrap();
+        }
+        let inputs = [base.join("a/x.txt"), base.join("b/x.txt")];
+        assert!(FileJob::for_files(&inputs, &base.join("out")).is_err());
+        assert_eq!(
+            FileJob::for_files(&inputs[..1], &base.join("out"))
+                .unwrap()
+                .len(),
+            1
+        );
+        std::fs::remove_dir_all(&base).unwrap();
+    }
+}
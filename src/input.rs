@@ -0,0 +1,210 @@
+//! Read-only access to input files.
+use std::fs::File;
+use std::io;
+use std::ops::Deref;
+use std::path::Path;
+
+/// Inputs smaller than this are always scanned on the calling thread.
+pub const PARALLEL_MIN_BYTES: usize = 1 << 20;
+
+/// The contents of an input file, memory-mapped where the platform supports it.
+///
+/// Mapping lets the batch modes scan a large file at memory bandwidth and hand disjoint
+/// slices of it to worker threads without copying.
+pub struct MappedFile {
+    #[cfg(unix)]
+    ptr: *mut libc::c_void,
+    #[cfg(unix)]
+    len: usize,
+    #[cfg(not(unix))]
+    data: Vec<u8>,
+}
+
+// The mapping is read-only and owned by this value for its whole lifetime.
+unsafe impl Send for MappedFile {}
+unsafe impl Sync for MappedFile {}
+
+impl MappedFile {
+    /// Maps the file at `path` into memory.
+    ///
+    /// # Returns
+    /// * `Ok(MappedFile)` - The mapped file. Empty files map to an empty slice.
+    /// * `Err(io::Error)` - If the file cannot be opened or mapped.
+    #[cfg(unix)]
+    pub fn open<P: AsRef<Path>>(path: P) -> io::Result<MappedFile> {
+        use std::os::unix::io::AsRawFd;
+
+        let file = File::open(path)?;
+        let len = usize::try_from(file.metadata()?.len())
+            .map_err(|_| io::Error::new(io::ErrorKind::InvalidInput, "input file too large"))?;
+        if len == 0 {
+            return Ok(MappedFile {
+                ptr: std::ptr::null_mut(),
+                len: 0,
+            });
+        }
+
+        // SAFETY: a fresh private read-only mapping of an open file descriptor.
+        let ptr = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                len,
+                libc::PROT_READ,
+                libc::MAP_PRIVATE,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+        // SAFETY: `ptr` and `len` describe the mapping created above. The advice is a hint only.
+        unsafe { libc::madvise(ptr, len, libc::MADV_SEQUENTIAL) };
+
+        Ok(MappedFile { ptr, len })
+    }
+
+    /// Reads the file at `path` into memory.
+    #[cfg(not(unix))]
+    pub fn open<P: AsRef<Path>>(path: P) -> io::Result<MappedFile> {
+        Ok(MappedFile {
+            data: std::fs::read(path)?,
+        })
+    }
+}
+
+impl Deref for MappedFile {
+    type Target = [u8];
+
+    #[cfg(unix)]
+    fn deref(&self) -> &[u8] {
+        if self.len == 0 {
+            return &[];
+        }
+        // SAFETY: the mapping stays valid and readable until `drop`.
+        unsafe { std::slice::from_raw_parts(self.ptr as *const u8, self.len) }
+    }
+
+    #[cfg(not(unix))]
+    fn deref(&self) -> &[u8] {
+        &self.data
+    }
+}
+
+#[cfg(unix)]
+impl Drop for MappedFile {
+    fn drop(&mut self) {
+        if self.len != 0 {
+            // SAFETY: unmaps exactly the mapping created in `open`.
+            unsafe { libc::munmap(self.ptr, self.len) };
+        }
+    }
+}
+
+/// Splits `data` into at most `parts` ranges that end on ASCII whitespace.
+///
+/// No token straddles two ranges, so each range can be processed independently. Every
+/// returned range is non-empty, and together they cover `data` in order.
+pub(crate) fn split_at_whitespace(data: &[u8], parts: usize) -> Vec<std::ops::Range<usize>> {
+    let parts = parts.max(1);
+    let step = data.len().div_ceil(parts).max(1);
+    let mut ranges = Vec::with_capacity(parts);
+    let mut start = 0;
+    while start < data.len() {
+        let mut end = (start + step).min(data.len());
+        while end < data.len() && !data[end - 1].is_ascii_whitespace() {
+            end += 1;
+        }
+        ranges.push(start..end);
+        start = end;
+    }
+    ranges
+}
+
+/// Applies `f` to the parts of `data`, on up to `threads` threads, and returns the results in
+/// input order.
+///
+/// Inputs smaller than [`PARALLEL_MIN_BYTES`] are handled as a single part on the calling
+/// thread; larger ones are cut by [`split_at_whitespace`] into one part per thread.
+///
+/// # Arguments
+/// * `data` - The input.
+/// * `threads` - The number of threads to use, at least 1.
+/// * `f` - Called with the bytes of a part and the offset of the part in `data`.
+pub(crate) fn map_parts<T: Send>(
+    data: &[u8],
+    threads: usize,
+    f: impl Fn(&[u8], usize) -> T + Sync,
+) -> Vec<T> {
+    if threads == 1 || data.len() < PARALLEL_MIN_BYTES {
+        return vec![f(data, 0)];
+    }
+    let f = &f;
+    std::thread::scope(|s| {
+        let handles: Vec<_> = split_at_whitespace(data, threads)
+            .into_iter()
+            .map(|range| s.spawn(move || f(&data[range.clone()], range.start)))
+            .collect();
+        handles
+            .into_iter()
+            .map(|h| h.join().expect("worker panicked"))
+            .collect()
+    })
+}
+
+/// Iterates over the whitespace-separated tokens of `data` with their byte offsets.
+pub(crate) fn tokens(data: &[u8]) -> impl Iterator<Item = (usize, &[u8])> {
+    let mut pos = 0;
+    std::iter::from_fn(move || {
+        while pos < data.len() && data[pos].is_ascii_whitespace() {
+            pos += 1;
+        }
+        if pos == data.len() {
+            return None;
+        }
+        let start = pos;
+        while pos < data.len() && !data[pos].is_ascii_whitespace() {
+            pos += 1;
+        }
+        Some((start, &data[start..pos]))
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn split_at_whitespace_never_splits_tokens() {
+        let data = b"12 345 6789\n0 1\t22";
+        for parts in 1..=data.len() + 1 {
+            let ranges = split_at_whitespace(data, parts);
+            assert!(ranges.len() <= parts);
+            assert_eq!(ranges.first().map(|r| r.start), Some(0));
+            assert_eq!(ranges.last().map(|r| r.end), Some(data.len()));
+            for pair in ranges.windows(2) {
+                assert_eq!(pair[0].end, pair[1].start);
+                assert!(data[pair[0].end - 1].is_ascii_whitespace());
+            }
+        }
+        assert!(split_at_whitespace(b"", 4).is_empty());
+    }
+
+    #[test]
+    fn tokens_yields_offsets_of_whitespace_separated_tokens() {
+        let found: Vec<_> = tokens(b"  12 345\n\t6 ").collect();
+        assert_eq!(found, [(2, &b"12"[..]), (5, &b"345"[..]), (10, &b"6"[..])]);
+        assert_eq!(tokens(b" \n ").count(), 0);
+    }
+
+    #[test]
+    fn mapped_file_reads_file_contents() -> io::Result<()> {
+        let path = std::env::temp_dir().join(format!("nconv-input-{}", std::process::id()));
+        std::fs::write(&path, b"0xFF 0x10\n")?;
+        let mapped = MappedFile::open(&path)?;
+        assert_eq!(&mapped[..], b"0xFF 0x10\n");
+        std::fs::write(&path, b"")?;
+        assert!(MappedFile::open(&path)?.is_empty());
+        std::fs::remove_file(&path)
+    }
+}
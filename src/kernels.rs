@@ -0,0 +1,229 @@
+//! Alternative parse and format kernels, selected per number system pair by the
+//! [`Profile`](crate::Profile).
+//!
+//! The SWAR ("SIMD within a register") parser validates and combines eight digits at a time
+//! in a `u64`. The split formatter writes digits with shifts for the power-of-two bases, and
+//! with `u64` divisions by a constant for decimal, instead of the general `u128` division
+//! loop. Both only handle the common case and leave everything else (errors, separators,
+//! overlong input) to the general code.
+use crate::NumSystem;
+
+const ONES: u64 = 0x0101_0101_0101_0101;
+const HIGH_BITS: u64 = 0x8080_8080_8080_8080;
+
+/// Returns the longest digit string of `base` that can never overflow a `u128`.
+pub(crate) const fn max_safe_digits(base: NumSystem) -> usize {
+    match base {
+        NumSystem::Bin => 128,
+        NumSystem::Oct => 42,
+        NumSystem::Dec => 38,
+        NumSystem::Hex => 32,
+    }
+}
+
+/// Returns a mask with the high bit set in every byte of `v` that lies in `lo..=hi`.
+///
+/// Every byte of `v` must be ASCII, so that the additions never carry between bytes.
+#[inline]
+fn bytes_in_range(v: u64, lo: u8, hi: u8) -> u64 {
+    let at_least_lo = v + ONES * (0x80 - lo as u64);
+    let above_hi = v + ONES * (0x7F - hi as u64);
+    at_least_lo & !above_hi & HIGH_BITS
+}
+
+/// Validates eight ASCII digits of `base` and returns their value, first digit most
+/// significant.
+#[inline]
+fn parse_word(word: [u8; 8], base: NumSystem) -> Option<u64> {
+    let v = u64::from_le_bytes(word);
+    if v & HIGH_BITS != 0 {
+        return None;
+    }
+    match base {
+        NumSystem::Bin => {
+            if bytes_in_range(v, b'0', b'1') != HIGH_BITS {
+                return None;
+            }
+            Some((v - ONES * b'0' as u64).wrapping_mul(0x8040_2010_0804_0201) >> 56)
+        }
+        NumSystem::Oct => {
+            if bytes_in_range(v, b'0', b'7') != HIGH_BITS {
+                return None;
+            }
+            let v = (v - ONES * b'0' as u64).swap_bytes();
+            let v = (v | v >> 5) & 0x003F_003F_003F_003F;
+            let v = (v | v >> 10) & 0x0000_0FFF_0000_0FFF;
+            Some((v | v >> 20) & 0xFF_FFFF)
+        }
+        NumSystem::Dec => {
+            if bytes_in_range(v, b'0', b'9') != HIGH_BITS {
+                return None;
+            }
+            let v = (v & 0x0F0F_0F0F_0F0F_0F0F).wrapping_mul(2561) >> 8;
+            let v = (v & 0x00FF_00FF_00FF_00FF).wrapping_mul(6_553_601) >> 16;
+            Some((v & 0x0000_FFFF_0000_FFFF).wrapping_mul(42_949_672_960_001) >> 32)
+        }
+        NumSystem::Hex => {
+            let digits = bytes_in_range(v, b'0', b'9');
+            let letters = bytes_in_range(v | (ONES * 0x20), b'a', b'f');
+            if digits | letters != HIGH_BITS {
+                return None;
+            }
+            // Letters have bit 6 set: their low nibble plus 9 is their value.
+            let nibbles = (v & 0x0F0F_0F0F_0F0F_0F0F) + ((v >> 6) & ONES) * 9;
+            let v = nibbles.swap_bytes();
+            let v = (v | v >> 4) & 0x00FF_00FF_00FF_00FF;
+            let v = (v | v >> 8) & 0x0000_FFFF_0000_FFFF;
+            Some((v | v >> 16) & 0xFFFF_FFFF)
+        }
+    }
+}
+
+/// Parses a string of digits of `base`, eight at a time.
+///
+/// # Returns
+/// The value, or `None` if `digits` is empty, longer than [`max_safe_digits`], or contains
+/// anything but digits of `base`. The caller then falls back to the general parser, which
+/// also reports the precise error.
+pub(crate) fn parse_swar(digits: &[u8], base: NumSystem) -> Option<u128> {
+    if digits.is_empty() || digits.len() > max_safe_digits(base) {
+        return None;
+    }
+    let radix = base as u32 as u128;
+    let word_scale = radix.pow(8);
+
+    // Fold the leading digits that do not fill a word one at a time.
+    let head = digits.len() % 8;
+    let mut value = 0u128;
+    for &b in &digits[..head] {
+        let d = crate::parser::DIGIT_VALUES[b as usize] as u128;
+        if d >= radix {
+            return None;
+        }
+        value = value * radix + d;
+    }
+    for word in digits[head..].chunks_exact(8) {
+        let word = parse_word(word.try_into().expect("chunks of eight"), base)?;
+        value = value * word_scale + word as u128;
+    }
+    Some(value)
+}
+
+/// Writes the digits of a value into the end of `buf` and returns them, like
+/// [`format_digits`](crate::format_digits), but without `u128` divisions by a variable.
+pub(crate) fn format_split(value: u128, target: NumSystem, buf: &mut [u8; 128]) -> &[u8] {
+    const DIGITS: &[u8; 16] = b"0123456789ABCDEF";
+
+    let mut pos = buf.len();
+    match target {
+        NumSystem::Dec => {
+            const TEN19: u128 = 10_000_000_000_000_000_000;
+            // Cut the value into 19-digit parts that each fit a u64.
+            let mut parts = [0u64; 3];
+            let mut count = 0;
+            let mut rest = value;
+            while rest > u64::MAX as u128 {
+                parts[count] = (rest % TEN19) as u64;
+                rest /= TEN19;
+                count += 1;
+            }
+            let mut write = |mut part: u64, min_digits: usize| {
+                let end = pos;
+                while part > 0 || end - pos < min_digits {
+                    pos -= 1;
+                    buf[pos] = b'0' + (part % 10) as u8;
+                    part /= 10;
+                }
+            };
+            for &part in &parts[..count] {
+                write(part, 19);
+            }
+            write(rest as u64, 1);
+        }
+        _ => {
+            let shift = (target as u32).trailing_zeros();
+            let mask = (target as u32 - 1) as u128;
+            let mut rest = value;
+            loop {
+                pos -= 1;
+                buf[pos] = DIGITS[(rest & mask) as usize];
+                rest >>= shift;
+                if rest == 0 {
+                    break;
+                }
+            }
+        }
+    }
+    &buf[pos..]
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::testing::XorShift;
+    use crate::{format_digits, parse_value};
+
+    const BASES: [NumSystem; 4] = [
+        NumSystem::Bin,
+        NumSystem::Oct,
+        NumSystem::Dec,
+        NumSystem::Hex,
+    ];
+
+    fn samples() -> Vec<u128> {
+        let mut values = vec![0, 1, 7, 8, 9, 10, 15, 16, 255, 256, 99_999_999, 100_000_000];
+        let mut rng = XorShift::new(0x9E37_79B9_7F4A_7C15);
+        for bits in 1..=128 {
+            values.push(rng.next_u128() >> (128 - bits));
+            values.push(u128::MAX >> (128 - bits));
+        }
+        values
+    }
+
+    #[test]
+    fn parse_swar_matches_the_general_parser() {
+        for base in BASES {
+            for value in samples() {
+                let mut buf = [0u8; 128];
+                let digits = format_digits(value, base, &mut buf);
+                let expected = match digits.len() <= max_safe_digits(base) {
+                    true => Some(value),
+                    false => None,
+                };
+                assert_eq!(parse_swar(digits, base), expected, "{:?} {}", base, value);
+                let lower = digits.to_ascii_lowercase();
+                assert_eq!(parse_swar(&lower, base), expected);
+            }
+        }
+    }
+
+    #[test]
+    fn parse_swar_rejects_every_non_digit() {
+        for base in BASES {
+            for b in 0..=255u8 {
+                let mut digits = *b"1000000000000001";
+                for pos in [0, 3, 8, 15] {
+                    let saved = digits[pos];
+                    digits[pos] = b;
+                    let text = std::str::from_utf8(&digits).ok();
+                    let expected = text.and_then(|t| parse_value(t, base).ok());
+                    assert_eq!(parse_swar(&digits, base), expected, "{:?} {:#x}", base, b);
+                    digits[pos] = saved;
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn format_split_matches_the_general_formatter() {
+        for base in BASES {
+            for value in samples() {
+                let (mut a, mut b) = ([0u8; 128], [0u8; 128]);
+                assert_eq!(
+                    format_split(value, base, &mut a),
+                    format_digits(value, base, &mut b)
+                );
+            }
+        }
+    }
+}
@@ -0,0 +1,405 @@
+//! Lane-parallel conversion of many short numbers at once.
+//!
+//! Instead of speeding up one number, these kernels convert [`LANES`] numbers side by side:
+//! tokens of equal length are transposed into a structure-of-arrays block with one number
+//! per lane, so every step of the digit loop is the same operation on all lanes. That is
+//! what SIMD units are built for, and each kernel is compiled for AVX-512 and AVX2 in
+//! addition to the baseline, picked at run time.
+//!
+//! Only tokens that are plain digits and always fit a `u64` take the lane path. Anything
+//! else, such as prefixes, separators, invalid digits or long numbers, is handed to the
+//! scalar kernels of the [`ConversionPlan`], which also report the precise errors.
+use crate::parser::{chunk_digits, DIGIT_VALUES};
+use crate::{ConversionError, ConversionPlan, NumSystem};
+
+/// The number of values converted side by side, one AVX-512 register of `u64`s.
+pub(crate) const LANES: usize = 8;
+
+/// Rows of a block: enough for 64 binary digits.
+const ROWS: usize = 64;
+
+/// Digits of [`LANES`] numbers, transposed so that `rows[i]` holds digit `i` of every lane.
+///
+/// Parsing fills the rows with digit values, formatting with digit characters.
+struct Block {
+    rows: [[u8; LANES]; ROWS],
+    len: usize,
+}
+
+impl Block {
+    fn new() -> Block {
+        Block {
+            rows: [[0; LANES]; ROWS],
+            len: 0,
+        }
+    }
+
+    /// Transposes the digit values of `tokens`, which all have `len <= ROWS` bytes.
+    fn gather(&mut self, tokens: [&[u8]; LANES], len: usize) {
+        self.len = len;
+        for (lane, token) in tokens.iter().enumerate() {
+            for (row, &b) in self.rows.iter_mut().zip(&token[..len]) {
+                row[lane] = DIGIT_VALUES[b as usize];
+            }
+        }
+    }
+}
+
+/// Folds the rows of `block` into one value per lane.
+///
+/// # Returns
+/// The values and a mask of the lanes that held a byte other than a digit of `BASE`.
+#[inline(always)]
+fn parse_rows<const BASE: u64>(block: &Block) -> ([u64; LANES], u32) {
+    let mut values = [0u64; LANES];
+    let mut invalid = [false; LANES];
+    for row in &block.rows[..block.len] {
+        for lane in 0..LANES {
+            invalid[lane] |= row[lane] as u64 >= BASE;
+            values[lane] = values[lane]
+                .wrapping_mul(BASE)
+                .wrapping_add(row[lane] as u64);
+        }
+    }
+    let mask = (0..LANES).fold(0, |mask, lane| mask | ((invalid[lane] as u32) << lane));
+    (values, mask)
+}
+
+/// Returns the upper-case digit character for `digit`.
+#[inline(always)]
+fn digit_char(digit: u8) -> u8 {
+    digit + if digit < 10 { b'0' } else { b'A' - 10 }
+}
+
+/// Writes the digit characters of one value per lane into `block`, least significant first.
+///
+/// # Returns
+/// The digit count of every lane.
+#[inline(always)]
+fn format_rows<const BASE: u64>(values: [u64; LANES], block: &mut Block) -> [u8; LANES] {
+    let mut counts = [1u8; LANES];
+    if BASE == 10 {
+        // Split each value into parts below 10^8 so the digit loop runs on u32 lanes, whose
+        // division by ten vectorizes; u64 division does not.
+        let mut parts = [[0u32; LANES]; 3];
+        for (lane, &v) in values.iter().enumerate() {
+            parts[0][lane] = (v % 100_000_000) as u32;
+            parts[1][lane] = (v / 100_000_000 % 100_000_000) as u32;
+            parts[2][lane] = (v / 10_000_000_000_000_000) as u32;
+        }
+        block.len = 20;
+        for (i, row) in block.rows[..20].iter_mut().enumerate() {
+            let part = &mut parts[i / 8];
+            for lane in 0..LANES {
+                let digit = (part[lane] % 10) as u8;
+                part[lane] /= 10;
+                row[lane] = digit + b'0';
+                if digit != 0 {
+                    counts[lane] = i as u8 + 1;
+                }
+            }
+        }
+        return counts;
+    }
+
+    let shift = BASE.trailing_zeros();
+    let widest = values.iter().fold(0, |acc, &v| acc | v);
+    block.len = (64 - widest.leading_zeros()).div_ceil(shift).max(1) as usize;
+    for (i, row) in block.rows[..block.len].iter_mut().enumerate() {
+        for lane in 0..LANES {
+            let digit = ((values[lane] >> (i as u32 * shift)) & (BASE - 1)) as u8;
+            row[lane] = digit_char(digit);
+            if digit != 0 {
+                counts[lane] = i as u8 + 1;
+            }
+        }
+    }
+    counts
+}
+
+/// Generates a function that runs a row kernel for a runtime base, compiled with the
+/// target features of the surrounding function.
+macro_rules! by_base {
+    ($name:ident, $kernel:ident, ($($arg:ident: $ty:ty),*) -> $ret:ty) => {
+        #[inline(always)]
+        fn $name(base: NumSystem, $($arg: $ty),*) -> $ret {
+            match base {
+                NumSystem::Bin => $kernel::<2>($($arg),*),
+                NumSystem::Oct => $kernel::<8>($($arg),*),
+                NumSystem::Dec => $kernel::<10>($($arg),*),
+                NumSystem::Hex => $kernel::<16>($($arg),*),
+            }
+        }
+    };
+}
+
+by_base!(parse_any, parse_rows, (block: &Block) -> ([u64; LANES], u32));
+by_base!(format_any, format_rows, (values: [u64; LANES], block: &mut Block) -> [u8; LANES]);
+
+#[cfg(target_arch = "x86_64")]
+mod x86 {
+    use super::*;
+
+    #[target_feature(enable = "avx512f,avx512bw,avx512dq,avx512vl")]
+    pub(super) fn parse_avx512(base: NumSystem, block: &Block) -> ([u64; LANES], u32) {
+        parse_any(base, block)
+    }
+
+    #[target_feature(enable = "avx2")]
+    pub(super) fn parse_avx2(base: NumSystem, block: &Block) -> ([u64; LANES], u32) {
+        parse_any(base, block)
+    }
+
+    #[target_feature(enable = "avx512f,avx512bw,avx512dq,avx512vl")]
+    pub(super) fn format_avx512(
+        base: NumSystem,
+        values: [u64; LANES],
+        block: &mut Block,
+    ) -> [u8; LANES] {
+        format_any(base, values, block)
+    }
+
+    #[target_feature(enable = "avx2")]
+    pub(super) fn format_avx2(
+        base: NumSystem,
+        values: [u64; LANES],
+        block: &mut Block,
+    ) -> [u8; LANES] {
+        format_any(base, values, block)
+    }
+
+    pub(super) fn has_avx512() -> bool {
+        is_x86_feature_detected!("avx512f")
+            && is_x86_feature_detected!("avx512bw")
+            && is_x86_feature_detected!("avx512dq")
+            && is_x86_feature_detected!("avx512vl")
+    }
+}
+
+fn parse_block(base: NumSystem, block: &Block) -> ([u64; LANES], u32) {
+    #[cfg(target_arch = "x86_64")]
+    {
+        // SAFETY: each variant only runs when the CPU supports its target features.
+        if x86::has_avx512() {
+            return unsafe { x86::parse_avx512(base, block) };
+        }
+        if is_x86_feature_detected!("avx2") {
+            return unsafe { x86::parse_avx2(base, block) };
+        }
+    }
+    parse_any(base, block)
+}
+
+fn format_block(base: NumSystem, values: [u64; LANES], block: &mut Block) -> [u8; LANES] {
+    #[cfg(target_arch = "x86_64")]
+    {
+        // SAFETY: each variant only runs when the CPU supports its target features.
+        if x86::has_avx512() {
+            return unsafe { x86::format_avx512(base, values, block) };
+        }
+        if is_x86_feature_detected!("avx2") {
+            return unsafe { x86::format_avx2(base, values, block) };
+        }
+    }
+    format_any(base, values, block)
+}
+
+/// Converts many tokens with the lane-parallel kernels, writing one line per converted token.
+///
+/// See [`ConversionPlan::convert_tokens`].
+pub(crate) fn convert_tokens(
+    plan: &ConversionPlan,
+    tokens: &[&[u8]],
+    out: &mut Vec<u8>,
+    on_error: &mut dyn FnMut(usize, ConversionError),
+) -> usize {
+    let parsed = parse_tokens(plan, tokens);
+    format_tokens(plan, tokens, &parsed, out, on_error, &mut |_| ())
+}
+
+/// The values of a run of tokens, from [`parse_tokens`].
+pub(crate) struct Parsed {
+    values: Vec<u128>,
+    /// Whether each token parsed; the value of a token that did not is 0.
+    parsed: Vec<bool>,
+}
+
+/// Parses `tokens`, grouping those short enough for u64 lanes by length and parsing them a
+/// block of lanes at a time.
+pub(crate) fn parse_tokens(plan: &ConversionPlan, tokens: &[&[u8]]) -> Parsed {
+    let max_len = chunk_digits(plan.src_base).0;
+    let mut values = vec![0u128; tokens.len()];
+    let mut parsed = vec![true; tokens.len()];
+    let mut parse_scalar = |i: usize, values: &mut [u128]| match plan.parse_bytes(tokens[i]) {
+        Ok(value) => values[i] = value,
+        Err(_) => parsed[i] = false,
+    };
+    let mut by_len: Vec<Vec<u32>> = vec![Vec::new(); max_len + 1];
+    for (i, token) in tokens.iter().enumerate() {
+        match by_len.get_mut(token.len()) {
+            Some(group) if !token.is_empty() => group.push(i as u32),
+            _ => parse_scalar(i, &mut values),
+        }
+    }
+    let mut block = Block::new();
+    for (len, group) in by_len.iter().enumerate() {
+        let mut blocks = group.chunks_exact(LANES);
+        for indices in blocks.by_ref() {
+            block.gather(
+                std::array::from_fn(|lane| tokens[indices[lane] as usize]),
+                len,
+            );
+            let (lane_values, invalid) = parse_block(plan.src_base, &block);
+            for (lane, &i) in indices.iter().enumerate() {
+                match (invalid >> lane) & 1 {
+                    0 => values[i as usize] = lane_values[lane] as u128,
+                    _ => parse_scalar(i as usize, &mut values),
+                }
+            }
+        }
+        blocks
+            .remainder()
+            .iter()
+            .for_each(|&i| parse_scalar(i as usize, &mut values));
+    }
+    Parsed { values, parsed }
+}
+
+/// Formats the `parsed` values of `tokens` in token order, writing one line per converted
+/// token and reporting the others to `on_error`. Blocks whose values all fit a u64 take the
+/// lane kernels; the other values are passed to `on_scalar` as they are formatted one at a
+/// time, which is where the small-value table is consulted.
+///
+/// # Returns
+/// The number of tokens converted.
+pub(crate) fn format_tokens(
+    plan: &ConversionPlan,
+    tokens: &[&[u8]],
+    parsed: &Parsed,
+    out: &mut Vec<u8>,
+    on_error: &mut dyn FnMut(usize, ConversionError),
+    on_scalar: &mut dyn FnMut(u128),
+) -> usize {
+    let Parsed { values, parsed } = parsed;
+    let mut block = Block::new();
+    let mut converted = 0;
+    let mut digits = [0u8; ROWS];
+    for (start, chunk) in values.chunks(LANES).enumerate() {
+        let start = start * LANES;
+        let ok = &parsed[start..start + chunk.len()];
+        let fits = chunk.len() == LANES
+            && ok.iter().all(|&ok| ok)
+            && chunk.iter().all(|&v| v <= u64::MAX as u128);
+        if !fits {
+            for (i, (&value, &ok)) in chunk.iter().zip(ok).enumerate() {
+                if ok {
+                    plan.format_into(value, out);
+                    out.push(b'\n');
+                    on_scalar(value);
+                    converted += 1;
+                } else {
+                    let token = tokens[start + i];
+                    on_error(
+                        start + i,
+                        plan.parse_bytes(token).expect_err("token failed"),
+                    );
+                }
+            }
+            continue;
+        }
+        let lane_values = std::array::from_fn(|lane| chunk[lane] as u64);
+        let counts = format_block(plan.tgt_base, lane_values, &mut block);
+        for (lane, &count) in counts.iter().enumerate() {
+            let count = count as usize;
+            for (digit, row) in digits[..count]
+                .iter_mut()
+                .zip(block.rows[..count].iter().rev())
+            {
+                *digit = row[lane];
+            }
+            plan.layout(&digits[..count], out);
+            out.push(b'\n');
+        }
+        converted += LANES;
+    }
+    converted
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::testing::XorShift;
+    use crate::Separators;
+
+    #[test]
+    fn lanes_match_the_scalar_path_in_every_layout() {
+        let bases = [
+            NumSystem::Bin,
+            NumSystem::Oct,
+            NumSystem::Dec,
+            NumSystem::Hex,
+        ];
+        let mut rng = XorShift::new(0x9E37_79B9_7F4A_7C15);
+        let values: Vec<u128> = (0..1000)
+            .map(|i| {
+                let x = rng.next_u64();
+                match i % 5 {
+                    0 => x as u128,
+                    1 => (x % 1000) as u128,
+                    2 => u64::MAX as u128,
+                    3 => 0,
+                    _ => (x >> (x % 64)) as u128,
+                }
+            })
+            .collect();
+        for src in bases {
+            let mut texts: Vec<Vec<u8>> = values
+                .iter()
+                .map(|&v| crate::format_value(v, src).into_bytes())
+                .collect();
+            texts[17] = b"12z".to_vec();
+            texts[300] = crate::format_value(u128::MAX, src).into_bytes();
+            let tokens: Vec<&[u8]> = texts.iter().map(Vec::as_slice).collect();
+            for tgt in bases {
+                for (grouping, width) in [(0, 1), (3, 12)] {
+                    let plan = ConversionPlan::new(src, tgt, grouping, width, Separators::none());
+                    let (mut expected, mut expected_errors) = (Vec::new(), Vec::new());
+                    for (i, token) in tokens.iter().enumerate() {
+                        match plan.parse_bytes(token) {
+                            Ok(v) => {
+                                plan.format_into(v, &mut expected);
+                                expected.push(b'\n');
+                            }
+                            Err(e) => expected_errors.push((i, e)),
+                        }
+                    }
+                    let (mut out, mut errors) = (Vec::new(), Vec::new());
+                    let converted =
+                        convert_tokens(&plan, &tokens, &mut out, &mut |i, e| errors.push((i, e)));
+                    assert_eq!(
+                        String::from_utf8(out).unwrap(),
+                        String::from_utf8(expected).unwrap()
+                    );
+                    assert_eq!(errors, expected_errors);
+                    assert_eq!(converted, tokens.len() - errors.len());
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn invalid_lanes_do_not_overflow() {
+        // Fifteen F digits make 0xFFF_FFFF_FFFF_FFFF, so the invalid byte after them, whose
+        // digit value is 0xFF, is added to 0xFFFF_FFFF_FFFF_FFF0.
+        let token = *b"FFFFFFFFFFFFFFF~";
+        let tokens = [&token[..]; LANES];
+        let plan = ConversionPlan::new(NumSystem::Hex, NumSystem::Dec, 0, 1, Separators::none());
+        let (mut out, mut errors) = (Vec::new(), 0);
+        assert_eq!(
+            convert_tokens(&plan, &tokens, &mut out, &mut |_, _| errors += 1),
+            0
+        );
+        assert!(out.is_empty());
+        assert_eq!(errors, LANES);
+    }
+}
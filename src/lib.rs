@@ -9,18 +9,20 @@
 //! - Support for common number prefixes (0b, 0o, 0x)
 //! - Configurable output width with zero padding
 //! - Optional digit grouping for improved readability
+//! - Optional separators between input digits, so grouped output can be parsed again
 //!
 //! # Examples
 //!
 //! ```
-//! use nconv::{Config, NumSystem};
+//! use nconv::{Config, NumSystem, Separators};
 //!
 //! let config = Config {
-//!     number: String::from("255"),
+//!     numbers: vec![String::from("255")],
 //!     src_base: NumSystem::Dec,
 //!     tgt_base: NumSystem::Hex,
 //!     width: 4,
 //!     grouping: 0,
+//!     separators: Separators::none(),
 //! };
 //!
 //! nconv::run(&config).unwrap();  // Prints: 00FF
@@ -35,6 +37,59 @@
 //! - Mismatched prefixes
 use clap::ValueEnum;
 use std::fmt::Display;
+use std::io::{self, BufWriter, Write};
+
+mod aggregate;
+mod batch;
+mod big;
+mod budget;
+mod check;
+mod checkpoint;
+mod files;
+mod input;
+mod kernels;
+mod lanes;
+mod metrics;
+mod mul;
+mod ntt;
+mod parser;
+mod plan;
+mod power_cache;
+mod profile;
+mod sort;
+mod stats;
+mod table;
+#[cfg(test)]
+mod testing;
+mod trace;
+#[cfg(target_os = "linux")]
+mod uring;
+
+pub use aggregate::{aggregate, Aggregate, AggregateConfig};
+pub use batch::{
+    convert_file, convert_file_checkpointed, BatchConfig, BatchReport, IoBackend,
+    DEFAULT_CHUNK_SIZE,
+};
+pub use big::BigUint;
+pub use check::{check, check_token, CheckConfig, CheckReport, TokenError};
+pub use checkpoint::{Checkpoint, OutputLayout, CHECKPOINT_INTERVAL};
+pub use files::{convert_files, FileError, FileJob};
+pub use input::{MappedFile, PARALLEL_MIN_BYTES};
+pub use metrics::{
+    enable_metrics, write_metrics, MetricsExporter, MetricsSnapshot, DEFAULT_METRICS_INTERVAL,
+};
+pub use mul::MulThresholds;
+pub use parser::{parse_value, parse_value_with_separators, Parser, Separators};
+pub use plan::ConversionPlan;
+pub use power_cache::set_power_cache;
+pub use profile::{current_profile, set_profile, FormatKernel, Kernels, ParseKernel, Profile};
+pub use sort::{sort_numbers, SortConfig, SortReport};
+pub use stats::Stats;
+pub use table::{
+    set_small_table_bits, small_table, small_table_memory, SmallTable, DEFAULT_SMALL_TABLE_BITS,
+    MAX_SMALL_TABLE_BITS,
+};
+pub use trace::{enable_tracing, write_trace};
 
 /// Represents the supported number systems for conversion.
 #[derive(Debug, Clone, Copy, PartialEq, ValueEnum)]
@@ -55,34 +110,38 @@ pub struct Config {
     pub src_base: NumSystem,
     /// The target number system to convert to.
     pub tgt_base: NumSystem,
-    /// The input number as a string.
-    pub number: String,
+    /// The input numbers as strings.
+    pub numbers: Vec<String>,
     /// The size of digit grouping (0 for no grouping).
     pub grouping: u32,
     /// The minimum width for zero-padding the output.
     pub width: u32,
+    /// Bytes skipped between the digits of the input number.
+    pub separators: Separators,
 }
 
 impl Config {
     pub fn new(
         src_base: NumSystem,
         tgt_base: NumSystem,
-        number: String,
+        numbers: Vec<String>,
         grouping: u32,
         width: u32,
+        separators: Separators,
     ) -> Config {
         Config {
             src_base,
             tgt_base,
-            number,
+            numbers,
             grouping,
             width,
+            separators,
         }
     }
 }
 
 /// Errors that can occur during number system conversion.
-#[derive(Debug)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
 pub enum ConversionError {
     /// Invalid digit found in input number (contains the invalid character).
     InvalidDigit(char),
@@ -90,6 +149,8 @@ pub enum ConversionError {
     NumberOverflow,
     /// Invalid base specified for conversion.
     InvalidBase,
+    /// The converted number could not be written out.
+    Output(std::io::ErrorKind),
 }
 
 impl Display for ConversionError {
@@ -98,6 +159,7 @@ impl Display for ConversionError {
             ConversionError::InvalidDigit(c) => write!(f, "invalid digit: '{}'", c),
             ConversionError::NumberOverflow => write!(f, "input value exceeds 128 bit limit"),
             ConversionError::InvalidBase => write!(f, "invalid base"),
+            ConversionError::Output(kind) => write!(f, "failed to write output: {}", kind),
         }
     }
 }
@@ -138,66 +200,99 @@ pub fn convert_base(
     src: NumSystem,
     target: NumSystem,
 ) -> Result<String, ConversionError> {
-    let digits = "0123456789ABCDEF";
-
-    // Handle prefixes and determine actual number string
-    let (num_str, inferred_src) = match num.to_lowercase().as_str() {
-        s if s.starts_with("0x") && src == NumSystem::Hex => (&num[2..], Some(NumSystem::Hex)),
-        s if s.starts_with("0o") && src == NumSystem::Oct => (&num[2..], Some(NumSystem::Oct)),
-        s if s.starts_with("0b") && src == NumSystem::Bin => (&num[2..], Some(NumSystem::Bin)),
-        s if s.starts_with("0x") || s.starts_with("0o") || s.starts_with("0b") => {
-            return Err(ConversionError::InvalidBase)
-        }
-        _ => (num, None),
-    };
-
-    // Use inferred source base if available, otherwise use provided src
-    let source_base = inferred_src.unwrap_or(src);
-
-    // First convert to decimal
-    let mut decimal = 0u128;
-    for c in num_str.chars() {
-        let digit = if c.is_ascii_digit() {
-            let d = c as u128 - '0' as u128;
-            if d >= source_base as u128 {
-                return Err(ConversionError::InvalidDigit(c));
-            }
-            d
-        } else {
-            let d = (c.to_ascii_uppercase() as u128) - ('A' as u128) + 10;
-            if d >= source_base as u128 {
-                return Err(ConversionError::InvalidDigit(c));
-            }
-            d
-        };
-
-        decimal = decimal
-            .checked_mul(source_base as u128)
-            .ok_or(ConversionError::NumberOverflow)?;
-        decimal = decimal
-            .checked_add(digit)
-            .ok_or(ConversionError::NumberOverflow)?;
-    }
+    convert_base_with_separators(num, src, target, Separators::none())
+}
+
+/// Converts a number string from one numeric base to another, skipping separators.
+///
+/// Behaves like [`convert_base`], except that any byte in `separators` may appear between
+/// the digits of `num`. This accepts the output of [`group_digits`] and underscore-separated
+/// literals without a separate stripping pass.
+///
+/// # Examples
+///
+/// ```
+/// use nconv::{convert_base_with_separators, NumSystem, Separators};
+///
+/// let separators = Separators::new(b" _");
+/// let result = convert_base_with_separators("DEAD BEEF", NumSystem::Hex, NumSystem::Dec, separators);
+/// assert_eq!(result.unwrap(), "3735928559");
+/// ```
+pub fn convert_base_with_separators(
+    num: &str,
+    src: NumSystem,
+    target: NumSystem,
+    separators: Separators,
+) -> Result<String, ConversionError> {
+    let decimal = parse_value_with_separators(num, src, separators)?;
 
     // Then convert to target base
-    if decimal == 0 {
-        return Ok("0".to_string());
+    Ok(format_value(decimal, target))
+}
+
+/// Formats a value as a digit string in the target number system.
+///
+/// Values below the small-value table bound are copied straight out of the shared
+/// [`SmallTable`] for `target`; all other values go through the general division loop.
+///
+/// # Arguments
+/// * `value` - The value to format.
+/// * `target` - The number system to write the digits in.
+///
+/// # Returns
+/// The digits of `value` without prefix or padding.
+///
+/// # Examples
+///
+/// ```
+/// use nconv::{format_value, NumSystem};
+///
+/// assert_eq!(format_value(255, NumSystem::Hex), "FF");
+/// assert_eq!(format_value(0, NumSystem::Bin), "0");
+/// ```
+pub fn format_value(value: u128, target: NumSystem) -> String {
+    match small_table(target).get(value) {
+        Some(digits) => digits.to_string(),
+        None => format_value_uncached(value, target),
     }
+}
 
-    let mut result = Vec::new();
-    let mut num = decimal;
-    while num > 0 {
-        let remainder = (num % target as u128) as usize;
-        result.push(
-            digits
-                .chars()
-                .nth(remainder)
-                .ok_or(ConversionError::InvalidBase)?,
-        );
-        num /= target as u128;
+/// Formats a value with the general division loop, bypassing the small-value tables.
+pub(crate) fn format_value_uncached(value: u128, target: NumSystem) -> String {
+    let mut buf = [0u8; 128];
+    format_digits(value, target, &mut buf)
+        .iter()
+        .map(|&b| b as char)
+        .collect()
+}
+
+/// Writes the digits of a value into the end of `buf` and returns them.
+///
+/// 128 binary digits is the longest possible output, so `buf` always has room.
+pub(crate) fn format_digits(value: u128, target: NumSystem, buf: &mut [u8; 128]) -> &[u8] {
+    const DIGITS: &[u8; 16] = b"0123456789ABCDEF";
+
+    let mut pos = buf.len();
+    let base = target as u128;
+    let mut num = value;
+    loop {
+        pos -= 1;
+        buf[pos] = DIGITS[(num % base) as usize];
+        num /= base;
+        if num == 0 {
+            break;
+        }
     }
 
-    Ok(result.iter().rev().collect())
+    &buf[pos..]
+}
+
+/// Resolves a requested worker thread count, where 0 means one per available core.
+pub(crate) fn worker_threads(requested: usize) -> usize {
+    match requested {
+        0 => std::thread::available_parallelism().map_or(1, |n| n.get()),
+        n => n,
+    }
 }
 
 /// Groups digits in a number string with specified spacing.
@@ -241,43 +336,68 @@ pub fn pad_width(num: &str, width: u32) -> String {
 
 /// Executes the number conversion process based on the provided configuration.
 ///
-/// This function performs the following steps:
+/// For each input number, this function performs the following steps:
 /// 1. Converts the number from source base to target base.
 /// 2. Pads the result to the specified width.
 /// 3. Groups digits according to the grouping configuration.
 /// 4. Prints the final result to stdout.
 ///
+/// All results go through a single buffered writer. A number that fails to convert is
+/// reported on stderr together with the offending argument, and the remaining numbers are
+/// still converted.
+///
 /// # Arguments
 ///
 /// * `config` - Reference to a Config struct containing conversion parameters.
 ///
 /// # Returns
 ///
-/// * `Ok(())` - If the conversion and output were successful.
-/// * `Err(ConversionError)` - If any step in the conversion process fails.
+/// * `Ok(())` - If every conversion and all output were successful.
+/// * `Err(ConversionError)` - The first error, if any number failed to convert or the
+///   output could not be written.
 ///
 /// # Examples
 ///
 /// ```
-/// use nconv::{Config, NumSystem};
+/// use nconv::{Config, NumSystem, Separators};
 ///
 /// let config = Config {
-///     number: String::from("1010"),
+///     numbers: vec![String::from("1010"), String::from("0b11")],
 ///     src_base: NumSystem::Bin,
 ///     tgt_base: NumSystem::Dec,
 ///     width: 0,
 ///     grouping: 0,
+///     separators: Separators::none(),
 /// };
 ///
-/// nconv::run(&config).unwrap();  // Prints: 10
+/// nconv::run(&config).unwrap();  // Prints: 10 and 3
 /// ```
 pub fn run(config: &Config) -> Result<(), ConversionError> {
-    let result = convert_base(&config.number, config.src_base, config.tgt_base)?;
-    let result = pad_width(&result, config.width);
-    let result = group_digits(&result, config.grouping);
-    println!("{}", result);
+    let plan = ConversionPlan::from_config(config);
+    let mut out = BufWriter::new(io::stdout().lock());
+    let mut line = Vec::new();
+    let mut first_error = None;
+
+    for number in &config.numbers {
+        match plan.parse(number) {
+            Ok(value) => {
+                line.clear();
+                plan.format_into(value, &mut line);
+                line.push(b'\n');
+                out.write_all(&line)
+                    .map_err(|e| ConversionError::Output(e.kind()))?;
+            }
+            Err(e) => {
+                // Keep stdout and stderr in argument order.
+                out.flush().map_err(|e| ConversionError::Output(e.kind()))?;
+                eprintln!("error: {}: {}", number, e);
+                first_error.get_or_insert(e);
+            }
+        }
+    }
 
-    Ok(())
+    out.flush().map_err(|e| ConversionError::Output(e.kind()))?;
+    first_error.map_or(Ok(()), Err)
 }
 
 #[cfg(test)]
@@ -364,6 +484,24 @@ mod tests {
         Ok(())
     }
 
+    #[test]
+    fn format_value_agrees_with_and_without_small_table() {
+        for base in [
+            NumSystem::Bin,
+            NumSystem::Oct,
+            NumSystem::Dec,
+            NumSystem::Hex,
+        ] {
+            for value in [0, 1, 7, 255, 65535, 65536, u64::MAX as u128, u128::MAX] {
+                assert_eq!(
+                    format_value(value, base),
+                    format_value_uncached(value, base)
+                );
+            }
+        }
+        assert_eq!(format_value(u128::MAX, NumSystem::Bin), "1".repeat(128));
+    }
+
     #[test]
     fn pad_width_successfully_applies_padding() {
         assert_eq!(pad_width("42", 4), "0042");
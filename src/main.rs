@@ -1,22 +1,34 @@
-use clap::Parser;
+use clap::builder::TypedValueParser;
+use clap::{CommandFactory, Parser, ValueEnum};
+use std::path::{Path, PathBuf};
+use std::time::Instant;
 
 #[derive(Parser, Debug)]
 #[command(version, about, long_about = None)]
+#[command(group = clap::ArgGroup::new("files").args(["input", "input_dir"]))]
 struct Args {
     #[arg(
         value_enum,
+        required_unless_present = "tune",
         help = "source number system"
     )]
-    src_base: nconv::NumSystem,
+    src_base: Option<nconv::NumSystem>,
 
     #[arg(
-        value_enum,
+        value_name = "TGT_BASE",
+        value_parser = TargetParser,
+        required_unless_present_any = ["check", "tune", "aggregate"],
         help = "target number system"
     )]
-    tgt_base: nconv::NumSystem,
+    tgt_base: Option<Target>,
 
-    #[arg(help = "a positive integer in the source number system")]
-    number: String,
+    #[arg(
+        value_name = "NUM",
+        required_unless_present_any = ["files", "tune", "aggregate"],
+        conflicts_with = "files",
+        help = "one or more positive integers in the source number system"
+    )]
+    numbers: Vec<String>,
 
     #[arg(
         short = 'g',
@@ -35,20 +47,746 @@ struct Args {
         help = "minimum number of digits in the output"
     )]
     width: u32,
+
+    #[arg(
+        short = 's',
+        long,
+        value_name = "CHARS",
+        default_value = "",
+        value_parser = parse_separators,
+        help = "characters allowed between input digits, e.g. \" _\" to accept grouped output"
+    )]
+    separators: nconv::Separators,
+
+    #[arg(
+        long,
+        value_parser = clap::value_parser!(u32).range(0..=nconv::MAX_SMALL_TABLE_BITS as i64),
+        help = "values below 2^BITS are formatted from a precomputed table (0 disables; \
+                default: 16 with --input, 0 for numbers given as arguments)"
+    )]
+    table_bits: Option<u32>,
+
+    #[arg(
+        long,
+        requires = "input",
+        help = "only validate the numbers in the input file, TGT_BASE is not needed"
+    )]
+    check: bool,
+
+    #[arg(
+        long,
+        value_name = "FILE",
+        help = "convert the whitespace-separated numbers in FILE, one per output line; \
+                may be repeated with --output-dir"
+    )]
+    input: Vec<PathBuf>,
+
+    #[arg(
+        long,
+        value_name = "DIR",
+        requires = "output_dir",
+        conflicts_with = "check",
+        help = "convert every file in DIR"
+    )]
+    input_dir: Option<PathBuf>,
+
+    #[arg(
+        long,
+        value_name = "DIR",
+        requires = "files",
+        conflicts_with_all = ["output", "check"],
+        help = "write the output of each input file to a file of the same name in DIR"
+    )]
+    output_dir: Option<PathBuf>,
+
+    #[arg(
+        short = 'o',
+        long,
+        value_name = "FILE",
+        requires = "input",
+        conflicts_with = "check",
+        help = "write the converted numbers to FILE instead of stdout"
+    )]
+    output: Option<PathBuf>,
+
+    #[arg(
+        long,
+        value_name = "FILE",
+        requires = "output",
+        help = "periodically sync the output and record the progress in FILE"
+    )]
+    checkpoint: Option<PathBuf>,
+
+    #[arg(
+        long,
+        requires = "checkpoint",
+        help = "continue an interrupted conversion from its checkpoint"
+    )]
+    resume: bool,
+
+    #[arg(
+        long,
+        value_enum,
+        default_value_t = nconv::IoBackend::Mmap,
+        requires = "files",
+        help = "how to read and write files"
+    )]
+    io: nconv::IoBackend,
+
+    #[arg(
+        long,
+        value_name = "BYTES",
+        default_value_t = nconv::DEFAULT_CHUNK_SIZE,
+        requires = "files",
+        help = "size of the input chunks handed to worker threads"
+    )]
+    chunk_size: usize,
+
+    #[arg(
+        long,
+        value_name = "SIZE",
+        default_value = "0",
+        value_parser = parse_size,
+        requires = "files",
+        conflicts_with = "check",
+        help = "memory limit for buffered chunks, e.g. 64M; chunks shrink to fit (0 for no limit)"
+    )]
+    max_memory: usize,
+
+    #[arg(
+        long,
+        default_value_t = 128,
+        value_parser = clap::value_parser!(u32).range(1..=128),
+        requires = "check",
+        help = "maximum width of a valid number in bits"
+    )]
+    bits: u32,
+
+    #[arg(
+        long,
+        value_name = "N",
+        default_value_t = 10,
+        requires = "check",
+        help = "maximum number of invalid numbers to report"
+    )]
+    max_errors: usize,
+
+    #[arg(
+        short = 'j',
+        long,
+        default_value_t = 0,
+        help = "number of worker threads for file modes (0 uses all cores)"
+    )]
+    threads: usize,
+
+    #[arg(
+        long,
+        conflicts_with_all = ["check", "output_dir", "checkpoint"],
+        help = "convert numbers of any size instead of at most 128 bits"
+    )]
+    big: bool,
+
+    #[arg(
+        long,
+        value_name = "DIR",
+        requires = "big",
+        help = "keep the decimal power tables of --big in DIR and reuse them in later runs"
+    )]
+    power_cache: Option<PathBuf>,
+
+    #[arg(
+        long,
+        conflicts_with_all = ["check", "big", "output_dir", "checkpoint"],
+        help = "write the numbers sorted by value instead of in input order"
+    )]
+    sort: bool,
+
+    #[arg(long, requires = "sort", help = "with --sort, write each distinct value only once")]
+    unique: bool,
+
+    #[arg(
+        long,
+        conflicts_with_all = ["check", "big", "sort", "output", "output_dir"],
+        help = "print the count, minimum, maximum, sum and bit widths of the numbers instead \
+                of converting them; TGT_BASE defaults to SRC_BASE"
+    )]
+    aggregate: bool,
+
+    #[arg(long, help = "print runtime statistics to stderr")]
+    stats: bool,
+
+    #[arg(
+        long,
+        value_name = "FILE",
+        requires = "files",
+        conflicts_with_all = ["check", "big", "sort", "aggregate"],
+        help = "periodically write Prometheus metrics to FILE, e.g. for the textfile collector"
+    )]
+    metrics: Option<PathBuf>,
+
+    #[arg(
+        long,
+        value_name = "SECS",
+        default_value_t = nconv::DEFAULT_METRICS_INTERVAL.as_secs(),
+        value_parser = clap::value_parser!(u64).range(1..),
+        requires = "metrics",
+        help = "seconds between two writes of the metrics file"
+    )]
+    metrics_interval: u64,
+
+    #[arg(
+        long,
+        value_name = "FILE",
+        requires = "files",
+        conflicts_with_all = ["check", "big", "sort", "aggregate"],
+        help = "write a timeline of the conversion stages to FILE in Chrome trace-event format"
+    )]
+    trace: Option<PathBuf>,
+
+    #[arg(
+        long,
+        conflicts_with_all = ["src_base", "files", "check"],
+        help = "measure the fastest conversion kernels on this machine and write the profile"
+    )]
+    tune: bool,
+
+    #[arg(
+        long,
+        value_name = "FILE",
+        help = "kernel profile to use or, with --tune, to write \
+                (default: $NCONV_PROFILE or ~/.cache/nconv/profile)"
+    )]
+    profile: Option<PathBuf>,
+}
+
+/// The second positional argument: the target number system or, with `--aggregate`, which
+/// does not need one, possibly the first number.
+#[derive(Debug, Clone, PartialEq)]
+enum Target {
+    Base(nconv::NumSystem),
+    Number(String),
+}
+
+/// Parses a [`Target`], listing the number systems in the help like a plain value enum.
+#[derive(Clone)]
+struct TargetParser;
+
+impl TypedValueParser for TargetParser {
+    type Value = Target;
+
+    fn parse_ref(
+        &self,
+        cmd: &clap::Command,
+        arg: Option<&clap::Arg>,
+        value: &std::ffi::OsStr,
+    ) -> Result<Target, clap::Error> {
+        let bases = clap::builder::EnumValueParser::<nconv::NumSystem>::new();
+        match bases.parse_ref(cmd, arg, value) {
+            Ok(base) => Ok(Target::Base(base)),
+            Err(_) => Ok(Target::Number(value.to_string_lossy().into_owned())),
+        }
+    }
+
+    fn possible_values(
+        &self,
+    ) -> Option<Box<dyn Iterator<Item = clap::builder::PossibleValue> + '_>> {
+        let bases = nconv::NumSystem::value_variants().iter();
+        Some(Box::new(bases.filter_map(ValueEnum::to_possible_value)))
+    }
+}
+
+/// Settles what the second positional argument was.
+///
+/// With `--aggregate` and numbers from the command line, a second positional argument that
+/// is not a number system is the first number. Anywhere else it is an invalid TGT_BASE.
+fn resolve_target(mut args: Args) -> Result<Args, clap::Error> {
+    let from_files = !args.input.is_empty() || args.input_dir.is_some();
+    if let Some(Target::Number(number)) = &args.tgt_base {
+        if !args.aggregate || from_files {
+            let mut cmd = Args::command();
+            cmd.build();
+            let arg = cmd.get_arguments().find(|a| a.get_id() == "tgt_base");
+            let bases = clap::builder::EnumValueParser::<nconv::NumSystem>::new();
+            let value = std::ffi::OsString::from(number);
+            return Err(bases.parse_ref(&cmd, arg, &value).expect_err("not a number system"));
+        }
+        args.numbers.insert(0, number.clone());
+        args.tgt_base = None;
+    }
+    if args.aggregate && !from_files && args.numbers.is_empty() {
+        return Err(Args::command().error(
+            clap::error::ErrorKind::MissingRequiredArgument,
+            "--aggregate needs numbers or --input",
+        ));
+    }
+    Ok(args)
+}
+
+fn parse_separators(chars: &str) -> Result<nconv::Separators, String> {
+    match chars.chars().find(|c| !c.is_ascii_punctuation() && *c != ' ') {
+        Some(c) => Err(format!("'{}' cannot be used as a separator", c)),
+        None => Ok(nconv::Separators::new(chars.as_bytes())),
+    }
+}
+
+fn parse_size(size: &str) -> Result<usize, String> {
+    let (digits, scale) = match size.char_indices().last() {
+        Some((i, 'K' | 'k')) => (&size[..i], 1 << 10),
+        Some((i, 'M' | 'm')) => (&size[..i], 1 << 20),
+        Some((i, 'G' | 'g')) => (&size[..i], 1 << 30),
+        _ => (size, 1),
+    };
+    digits
+        .parse::<usize>()
+        .ok()
+        .and_then(|n| n.checked_mul(scale))
+        .ok_or_else(|| format!("'{}' is not a size in bytes, K, M or G", size))
+}
+
+/// Measures the conversion kernels and stores the resulting profile.
+fn tune(args: &Args) -> std::io::Result<()> {
+    let path = match args.profile.clone().or_else(nconv::Profile::default_path) {
+        Some(path) => path,
+        None => {
+            return Err(std::io::Error::new(
+                std::io::ErrorKind::NotFound,
+                "no profile location, set --profile or $NCONV_PROFILE",
+            ))
+        }
+    };
+    let profile = nconv::Profile::tune();
+    profile
+        .store(&path)
+        .map_err(|e| std::io::Error::new(e.kind(), format!("{}: {}", path.display(), e)))?;
+    print!("{}", profile);
+    eprintln!("profile written to {}", path.display());
+    Ok(())
+}
+
+/// Prefixes the message of `e` with `path`.
+fn at(path: &Path, e: std::io::Error) -> std::io::Error {
+    std::io::Error::new(e.kind(), format!("{}: {}", path.display(), e))
+}
+
+/// Runs `convert` while writing metrics to the `--metrics` file and recording a timeline
+/// for the `--trace` file, if they are given.
+///
+/// The final metrics and the trace are written even if `convert` or one of them fails; the
+/// first error of the three is returned.
+fn observed<T>(
+    args: &Args,
+    convert: impl FnOnce() -> std::io::Result<T>,
+) -> std::io::Result<T> {
+    if args.trace.is_some() {
+        nconv::enable_tracing();
+    }
+    let interval = std::time::Duration::from_secs(args.metrics_interval);
+    let exporter = args
+        .metrics
+        .as_ref()
+        .map(|path| nconv::MetricsExporter::start(path.clone(), interval));
+
+    let result = convert();
+    let metrics = match (exporter, &args.metrics) {
+        (Some(exporter), Some(path)) => exporter.finish().map_err(|e| at(path, e)),
+        _ => Ok(()),
+    };
+    let trace = match &args.trace {
+        Some(path) => nconv::write_trace(path).map_err(|e| at(path, e)),
+        None => Ok(()),
+    };
+    let value = result?;
+    metrics?;
+    trace?;
+    Ok(value)
+}
+
+/// Converts the numbers in the input file, reporting failures on stderr.
+///
+/// Returns whether every number was converted.
+fn convert(args: &Args, input: &Path, plan: nconv::ConversionPlan) -> std::io::Result<bool> {
+    let config = nconv::BatchConfig::new(
+        plan,
+        args.threads,
+        args.chunk_size,
+        args.io,
+        args.max_memory,
+    );
+
+    let start = Instant::now();
+    let mut report_error =
+        |e: nconv::TokenError| eprintln!("error: byte {}: {}", e.offset, e.error);
+    let report = match (&args.output, &args.checkpoint) {
+        (Some(output), Some(checkpoint)) => nconv::convert_file_checkpointed(
+            input,
+            output,
+            checkpoint,
+            args.resume,
+            &config,
+            &mut report_error,
+        )?,
+        (output, _) => {
+            nconv::convert_file(input, output.as_deref(), &config, &mut report_error)?
+        }
+    };
+    if args.stats {
+        let stats = nconv::Stats::collect().with_batch(report.clone(), start.elapsed());
+        eprintln!("{}", stats);
+    }
+
+    Ok(report.failed == 0)
+}
+
+/// Converts arbitrarily large numbers from the arguments or the input file, one per line.
+///
+/// Output is streamed, so only the numbers themselves are held in memory, not their text.
+///
+/// Returns whether every number was converted.
+fn convert_big(args: &Args, plan: nconv::ConversionPlan) -> std::io::Result<bool> {
+    use std::io::Write;
+
+    let mapped;
+    let numbers: Vec<&[u8]> = match args.input.first() {
+        Some(input) => {
+            mapped = nconv::MappedFile::open(input)?;
+            mapped
+                .split(u8::is_ascii_whitespace)
+                .filter(|token| !token.is_empty())
+                .collect()
+        }
+        None => args.numbers.iter().map(|n| n.as_bytes()).collect(),
+    };
+    let out: Box<dyn Write> = match &args.output {
+        Some(path) => Box::new(std::fs::File::create(path)?),
+        None => Box::new(std::io::stdout().lock()),
+    };
+    let mut out = std::io::BufWriter::new(out);
+
+    let mut ok = true;
+    for number in numbers {
+        match plan.convert_big_to(number, &mut out) {
+            Ok(()) => out.write_all(b"\n")?,
+            Err(nconv::ConversionError::Output(kind)) => return Err(kind.into()),
+            Err(e) => {
+                out.flush()?;
+                eprintln!("error: {}: {}", String::from_utf8_lossy(number), e);
+                ok = false;
+            }
+        }
+    }
+    out.flush()?;
+    Ok(ok)
+}
+
+/// Sorts the numbers from the arguments or the input file by value, reporting invalid ones
+/// on stderr.
+///
+/// Returns whether every number was valid.
+fn sort(args: &Args, plan: nconv::ConversionPlan) -> std::io::Result<bool> {
+    use std::io::Write;
+
+    let (mapped, joined);
+    let data: &[u8] = match args.input.first() {
+        Some(input) => {
+            mapped = nconv::MappedFile::open(input)?;
+            &mapped
+        }
+        None => {
+            joined = args.numbers.join("\n");
+            joined.as_bytes()
+        }
+    };
+    let out: Box<dyn Write> = match &args.output {
+        Some(path) => Box::new(std::fs::File::create(path)?),
+        None => Box::new(std::io::stdout().lock()),
+    };
+    let mut out = std::io::BufWriter::new(out);
+
+    let config = nconv::SortConfig::new(plan, args.unique, args.threads);
+    let mut errors = Vec::new();
+    let report = nconv::sort_numbers(data, &config, &mut out, &mut |e| errors.push(e))?;
+    out.flush()?;
+    for e in errors {
+        match args.input.first() {
+            Some(_) => eprintln!("error: byte {}: {}", e.offset, e.error),
+            None => eprintln!("error: {}", e.error),
+        }
+    }
+    if args.stats {
+        eprintln!("{}", nconv::Stats::collect());
+        eprintln!("numbers sorted: {}", report.written);
+        eprintln!("duplicates removed: {}", report.duplicates);
+        eprintln!("numbers failed: {}", report.invalid);
+    }
+
+    Ok(report.invalid == 0)
+}
+
+/// Prints the statistics of the numbers from the arguments or the input file, reporting
+/// invalid ones on stderr.
+///
+/// Returns whether every number was valid.
+fn aggregate(args: &Args, plan: nconv::ConversionPlan) -> std::io::Result<bool> {
+    let (mapped, joined);
+    let data: &[u8] = match args.input.first() {
+        Some(input) => {
+            mapped = nconv::MappedFile::open(input)?;
+            &mapped
+        }
+        None => {
+            joined = args.numbers.join("\n");
+            joined.as_bytes()
+        }
+    };
+
+    let config = nconv::AggregateConfig::new(plan, args.threads);
+    let report = nconv::aggregate(data, &config, &mut |e| match args.input.first() {
+        Some(_) => eprintln!("error: byte {}: {}", e.offset, e.error),
+        None => eprintln!("error: {}", e.error),
+    });
+    report.write_to(&plan, &mut std::io::stdout().lock())?;
+    if args.stats {
+        eprintln!("{}", nconv::Stats::collect());
+    }
+
+    Ok(report.invalid == 0)
+}
+
+/// Converts each input file into the output directory, reporting failures on stderr.
+///
+/// Returns whether every file and every number was converted.
+fn convert_all(
+    args: &Args,
+    output_dir: &Path,
+    plan: nconv::ConversionPlan,
+) -> std::io::Result<bool> {
+    let jobs = match &args.input_dir {
+        Some(dir) => nconv::FileJob::for_directory(dir, output_dir)?,
+        None => nconv::FileJob::for_files(&args.input, output_dir)?,
+    };
+    std::fs::create_dir_all(output_dir)
+        .map_err(|e| std::io::Error::new(e.kind(), format!("{}: {}", output_dir.display(), e)))?;
+    let config = nconv::BatchConfig::new(
+        plan,
+        args.threads,
+        args.chunk_size,
+        args.io,
+        args.max_memory,
+    );
+
+    let start = Instant::now();
+    let report = nconv::convert_files(&jobs, &config, &|path, e| {
+        eprintln!("error: {}: {}", path.display(), e)
+    });
+    if args.stats {
+        let stats = nconv::Stats::collect().with_batch(report.clone(), start.elapsed());
+        eprintln!("{}", stats);
+    }
+
+    Ok(report.failed == 0 && report.files_failed == 0)
+}
+
+/// Validates the input file and prints a report.
+///
+/// Returns whether every number in the file was valid.
+fn check(args: &Args, input: &Path, src_base: nconv::NumSystem) -> std::io::Result<bool> {
+    let data = nconv::MappedFile::open(input)?;
+    let config = nconv::CheckConfig::new(src_base, args.bits, args.max_errors, args.threads);
+    let report = nconv::check(&data, &config);
+
+    println!("valid: {}", report.valid);
+    println!("invalid: {}", report.invalid);
+    for e in &report.errors {
+        match e.error {
+            nconv::ConversionError::NumberOverflow => {
+                println!("byte {}: input value exceeds {} bit limit", e.offset, args.bits)
+            }
+            error => println!("byte {}: {}", e.offset, error),
+        }
+    }
+
+    Ok(report.invalid == 0)
 }
 
 fn main() {
-    let args = Args::parse();
+    let args = resolve_target(Args::parse()).unwrap_or_else(|e| e.exit());
+    // Building the table only pays off over the many values of an input file.
+    let table_bits = match args.input.is_empty() && !args.tune {
+        true => 0,
+        false => nconv::DEFAULT_SMALL_TABLE_BITS,
+    };
+    nconv::set_small_table_bits(args.table_bits.unwrap_or(table_bits));
+
+    if args.input.len() > 1 && args.output_dir.is_none() {
+        Args::command()
+            .error(
+                clap::error::ErrorKind::ArgumentConflict,
+                "--input can only be given once without --output-dir",
+            )
+            .exit();
+    }
+
+    if args.tune {
+        if let Err(e) = tune(&args) {
+            eprintln!("error: {}", e);
+            std::process::exit(1);
+        }
+        return;
+    }
+    if let Some(path) = &args.profile {
+        match nconv::Profile::load(path) {
+            Ok(profile) => nconv::set_profile(profile),
+            Err(e) => {
+                eprintln!("error: {}: {}", path.display(), e);
+                std::process::exit(1);
+            }
+        }
+    }
+
+    let src_base = args.src_base.expect("required by clap");
+    if let (true, Some(input)) = (args.check, args.input.first()) {
+        let result = check(&args, input, src_base);
+        if args.stats {
+            eprintln!("{}", nconv::Stats::collect());
+        }
+        match result {
+            Ok(true) => return,
+            Ok(false) => std::process::exit(1),
+            Err(e) => {
+                eprintln!("error: {}: {}", input.display(), e);
+                std::process::exit(1);
+            }
+        }
+    }
+
+    let tgt_base = match (&args.tgt_base, args.aggregate) {
+        (Some(Target::Base(base)), _) => *base,
+        (_, true) => src_base,
+        _ => unreachable!("required by clap and resolve_target"),
+    };
+    let plan = nconv::ConversionPlan::new(
+        src_base,
+        tgt_base,
+        args.grouping,
+        args.width,
+        args.separators,
+    );
+    if args.big {
+        if let Some(dir) = &args.power_cache {
+            if let Err(e) = nconv::set_power_cache(dir) {
+                eprintln!("error: {}: {}", dir.display(), e);
+                std::process::exit(1);
+            }
+        }
+        let result = convert_big(&args, plan);
+        if args.stats {
+            eprintln!("{}", nconv::Stats::collect());
+        }
+        match result {
+            Ok(true) => return,
+            Ok(false) => std::process::exit(1),
+            Err(e) => {
+                eprintln!("error: {}", e);
+                std::process::exit(1);
+            }
+        }
+    }
+    if args.sort {
+        match sort(&args, plan) {
+            Ok(true) => return,
+            Ok(false) => std::process::exit(1),
+            Err(e) => {
+                eprintln!("error: {}", e);
+                std::process::exit(1);
+            }
+        }
+    }
+    if args.aggregate {
+        match aggregate(&args, plan) {
+            Ok(true) => return,
+            Ok(false) => std::process::exit(1),
+            Err(e) => {
+                eprintln!("error: {}", e);
+                std::process::exit(1);
+            }
+        }
+    }
+    if let Some(output_dir) = &args.output_dir {
+        match observed(&args, || convert_all(&args, output_dir, plan)) {
+            Ok(true) => return,
+            Ok(false) => std::process::exit(1),
+            Err(e) => {
+                eprintln!("error: {}", e);
+                std::process::exit(1);
+            }
+        }
+    }
+    if let Some(input) = args.input.first() {
+        match observed(&args, || convert(&args, input, plan)) {
+            Ok(true) => return,
+            Ok(false) => std::process::exit(1),
+            Err(e) => {
+                eprintln!("error: {}: {}", input.display(), e);
+                std::process::exit(1);
+            }
+        }
+    }
+
     let config = nconv::Config::new(
-        args.src_base,
-        args.tgt_base,
-        args.number,
+        src_base,
+        tgt_base,
+        args.numbers.clone(),
         args.grouping,
         args.width,
+        args.separators,
     );
 
-    if let Err(e) = nconv::run(&config) {
-        eprintln!("error: {}", e);
-        std::process::exit(1);
+    let result = nconv::run(&config);
+    if args.stats {
+        eprintln!("{}", nconv::Stats::collect());
+    }
+    match result {
+        // Conversion errors have already been reported for each argument.
+        Err(nconv::ConversionError::Output(kind)) => {
+            eprintln!("error: failed to write output: {}", kind);
+            std::process::exit(1);
+        }
+        Err(_) => std::process::exit(1),
+        Ok(()) => (),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn parse(argv: &[&str]) -> Result<Args, clap::Error> {
+        resolve_target(Args::try_parse_from([&["nconv"], argv].concat())?)
+    }
+
+    #[test]
+    fn aggregate_takes_numbers_without_a_target_base() {
+        let args = parse(&["--aggregate", "hex", "ff", "10"]).unwrap();
+        assert_eq!(args.tgt_base, None);
+        assert_eq!(args.numbers, ["ff", "10"]);
+
+        let args = parse(&["--aggregate", "hex", "dec", "ff"]).unwrap();
+        assert_eq!(args.tgt_base, Some(Target::Base(nconv::NumSystem::Dec)));
+        assert_eq!(args.numbers, ["ff"]);
+
+        let args = parse(&["--aggregate", "hex", "ff"]).unwrap();
+        assert_eq!(args.numbers, ["ff"]);
+        // "dec" names a number system, so there is nothing left to aggregate.
+        assert!(parse(&["--aggregate", "hex", "dec"]).is_err());
+    }
+
+    #[test]
+    fn target_base_must_be_a_number_system_elsewhere() {
+        let error = parse(&["hex", "ff", "10"]).unwrap_err();
+        assert_eq!(error.kind(), clap::error::ErrorKind::InvalidValue);
+        assert!(error.to_string().contains("invalid value 'ff'"));
+        let error = parse(&["--aggregate", "hex", "ff", "--input", "numbers.txt"]).unwrap_err();
+        assert_eq!(error.kind(), clap::error::ErrorKind::InvalidValue);
+        assert!(parse(&["hex", "dec", "ff"]).is_ok());
     }
 }
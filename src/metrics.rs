@@ -0,0 +1,472 @@
+//! Conversion metrics for monitoring long batch runs.
+//!
+//! Every thread counts into its own shard of atomics, which only that thread writes, so
+//! recording a metric is a plain load and store without locks or shared cache lines. A
+//! [`MetricsExporter`] periodically sums the shards into a [`MetricsSnapshot`] and writes it
+//! in the Prometheus text exposition format, e.g. for the node exporter's textfile collector.
+//! Nothing is recorded until [`enable_metrics`] is called.
+use crate::ConversionError;
+use std::fmt::Display;
+use std::io::{self, Write};
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::{mpsc, Arc, Mutex};
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant, SystemTime, UNIX_EPOCH};
+
+/// The default time between two writes of the metrics file.
+pub const DEFAULT_METRICS_INTERVAL: Duration = Duration::from_secs(10);
+
+/// A counter recorded by the batch modes.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub(crate) enum Counter {
+    Converted,
+    BytesRead,
+    BytesWritten,
+    FilesConverted,
+    FilesFailed,
+    InvalidDigit,
+    Overflow,
+    InvalidBase,
+    OutputError,
+    ReadNanos,
+    ConvertNanos,
+    WriteNanos,
+    TableLookups,
+    TableHits,
+}
+
+const COUNTERS: usize = Counter::TableHits as usize + 1;
+
+/// The upper bounds of the chunk latency histogram buckets, in seconds.
+const LATENCY_BUCKETS: [f64; 10] = [
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.1, 1.0,
+];
+
+/// The counts of one thread, aligned so that no two threads share a cache line.
+#[repr(align(128))]
+struct Shard {
+    counters: [AtomicU64; COUNTERS],
+    /// Chunk latencies per bucket; the last one counts those above every bound.
+    latency: [AtomicU64; LATENCY_BUCKETS.len() + 1],
+    latency_nanos: AtomicU64,
+}
+
+impl Shard {
+    const fn new() -> Shard {
+        Shard {
+            counters: [const { AtomicU64::new(0) }; COUNTERS],
+            latency: [const { AtomicU64::new(0) }; LATENCY_BUCKETS.len() + 1],
+            latency_nanos: AtomicU64::new(0),
+        }
+    }
+
+    /// Adds `n` to `cell`, which only the owning thread writes.
+    #[inline]
+    fn bump(cell: &AtomicU64, n: u64) {
+        cell.store(
+            cell.load(Ordering::Relaxed).wrapping_add(n),
+            Ordering::Relaxed,
+        );
+    }
+
+    fn cells(&self) -> impl Iterator<Item = &AtomicU64> {
+        self.counters
+            .iter()
+            .chain(&self.latency)
+            .chain([&self.latency_nanos])
+    }
+}
+
+static ENABLED: AtomicBool = AtomicBool::new(false);
+
+/// The shards of the running threads.
+static SHARDS: Mutex<Vec<Arc<Shard>>> = Mutex::new(Vec::new());
+
+/// The summed counts of the threads that have exited.
+static RETIRED: Shard = Shard::new();
+
+/// A thread's shard, folded into [`RETIRED`] when the thread exits.
+struct Registration(Arc<Shard>);
+
+impl Drop for Registration {
+    fn drop(&mut self) {
+        let mut shards = SHARDS.lock().expect("metrics poisoned");
+        shards.retain(|shard| !Arc::ptr_eq(shard, &self.0));
+        for (total, cell) in RETIRED.cells().zip(self.0.cells()) {
+            total.fetch_add(cell.load(Ordering::Relaxed), Ordering::Relaxed);
+        }
+    }
+}
+
+thread_local! {
+    static SHARD: Registration = {
+        let shard = Arc::new(Shard::new());
+        SHARDS.lock().expect("metrics poisoned").push(shard.clone());
+        Registration(shard)
+    };
+}
+
+/// Runs `record` on the calling thread's shard if metrics are enabled.
+#[inline]
+fn record(record: impl FnOnce(&Shard)) {
+    if enabled() {
+        // Fails only while the thread is exiting, when its counts are being retired.
+        let _ = SHARD.try_with(|registration| record(&registration.0));
+    }
+}
+
+/// Starts recording metrics for the rest of the process.
+pub fn enable_metrics() {
+    ENABLED.store(true, Ordering::Relaxed);
+}
+
+/// Returns whether metrics are being recorded.
+#[inline]
+pub(crate) fn enabled() -> bool {
+    ENABLED.load(Ordering::Relaxed)
+}
+
+/// Adds `n` to `counter`.
+pub(crate) fn count(counter: Counter, n: u64) {
+    record(|shard| Shard::bump(&shard.counters[counter as usize], n));
+}
+
+/// Returns the current time if metrics are enabled, to pass to [`count_time`] later.
+pub(crate) fn start_timer() -> Option<Instant> {
+    enabled().then(Instant::now)
+}
+
+/// Adds the nanoseconds since `started` to `counter`.
+pub(crate) fn count_time(counter: Counter, started: Option<Instant>) {
+    if let Some(started) = started {
+        count(counter, started.elapsed().as_nanos() as u64);
+    }
+}
+
+/// Counts a failed conversion by the kind of its error.
+pub(crate) fn count_error(error: &ConversionError) {
+    let counter = match error {
+        ConversionError::InvalidDigit(_) => Counter::InvalidDigit,
+        ConversionError::NumberOverflow => Counter::Overflow,
+        ConversionError::InvalidBase => Counter::InvalidBase,
+        ConversionError::Output(_) => Counter::OutputError,
+    };
+    count(counter, 1);
+}
+
+/// Records a chunk that took from `started` until now to convert.
+pub(crate) fn observe_chunk(started: Option<Instant>) {
+    let Some(started) = started else { return };
+    let elapsed = started.elapsed();
+    let bucket = LATENCY_BUCKETS
+        .iter()
+        .position(|&bound| elapsed.as_secs_f64() <= bound)
+        .unwrap_or(LATENCY_BUCKETS.len());
+    let nanos = elapsed.as_nanos() as u64;
+    record(|shard| {
+        Shard::bump(&shard.counters[Counter::ConvertNanos as usize], nanos);
+        Shard::bump(&shard.latency[bucket], 1);
+        Shard::bump(&shard.latency_nanos, nanos);
+    });
+}
+
+/// The metrics of all threads, summed at one point in time.
+#[derive(Debug, Clone, PartialEq)]
+pub struct MetricsSnapshot {
+    counters: [u64; COUNTERS],
+    latency: [u64; LATENCY_BUCKETS.len() + 1],
+    latency_nanos: u64,
+    /// When the snapshot was taken.
+    time: SystemTime,
+}
+
+impl MetricsSnapshot {
+    /// Sums the counts of every thread that has recorded metrics.
+    pub fn collect() -> MetricsSnapshot {
+        let mut totals = [0u64; COUNTERS + LATENCY_BUCKETS.len() + 2];
+        let shards = SHARDS.lock().expect("metrics poisoned");
+        for shard in shards.iter().map(Arc::as_ref).chain([&RETIRED]) {
+            for (total, cell) in totals.iter_mut().zip(shard.cells()) {
+                *total += cell.load(Ordering::Relaxed);
+            }
+        }
+        let (counters, rest) = totals.split_at(COUNTERS);
+        let (latency, rest) = rest.split_at(LATENCY_BUCKETS.len() + 1);
+        MetricsSnapshot {
+            counters: counters.try_into().expect("counter totals"),
+            latency: latency.try_into().expect("latency totals"),
+            latency_nanos: rest[0],
+            time: SystemTime::now(),
+        }
+    }
+
+    fn get(&self, counter: Counter) -> u64 {
+        self.counters[counter as usize]
+    }
+
+    fn seconds(&self, counter: Counter) -> f64 {
+        self.get(counter) as f64 / 1e9
+    }
+}
+
+impl Display for MetricsSnapshot {
+    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+        let header = |f: &mut std::fmt::Formatter, name: &str, kind: &str, help: &str| {
+            writeln!(f, "# HELP nconv_{} {}", name, help)?;
+            writeln!(f, "# TYPE nconv_{} {}", name, kind)
+        };
+
+        header(
+            f,
+            "numbers_converted_total",
+            "counter",
+            "Numbers converted.",
+        )?;
+        writeln!(
+            f,
+            "nconv_numbers_converted_total {}",
+            self.get(Counter::Converted)
+        )?;
+        header(
+            f,
+            "errors_total",
+            "counter",
+            "Numbers that failed to convert, by error.",
+        )?;
+        for (kind, counter) in [
+            ("invalid_digit", Counter::InvalidDigit),
+            ("overflow", Counter::Overflow),
+            ("invalid_base", Counter::InvalidBase),
+            ("output", Counter::OutputError),
+        ] {
+            writeln!(
+                f,
+                "nconv_errors_total{{kind=\"{}\"}} {}",
+                kind,
+                self.get(counter)
+            )?;
+        }
+        header(f, "read_bytes_total", "counter", "Input bytes converted.")?;
+        writeln!(f, "nconv_read_bytes_total {}", self.get(Counter::BytesRead))?;
+        header(f, "written_bytes_total", "counter", "Output bytes written.")?;
+        writeln!(
+            f,
+            "nconv_written_bytes_total {}",
+            self.get(Counter::BytesWritten)
+        )?;
+        header(f, "files_total", "counter", "Files processed, by result.")?;
+        writeln!(
+            f,
+            "nconv_files_total{{result=\"converted\"}} {}",
+            self.get(Counter::FilesConverted)
+        )?;
+        writeln!(
+            f,
+            "nconv_files_total{{result=\"failed\"}} {}",
+            self.get(Counter::FilesFailed)
+        )?;
+
+        header(
+            f,
+            "stage_seconds_total",
+            "counter",
+            "Time spent in each pipeline stage, summed over threads.",
+        )?;
+        for (stage, counter) in [
+            ("read", Counter::ReadNanos),
+            ("convert", Counter::ConvertNanos),
+            ("write", Counter::WriteNanos),
+        ] {
+            writeln!(
+                f,
+                "nconv_stage_seconds_total{{stage=\"{}\"}} {:.9}",
+                stage,
+                self.seconds(counter)
+            )?;
+        }
+
+        let (lookups, hits) = (
+            self.get(Counter::TableLookups),
+            self.get(Counter::TableHits),
+        );
+        header(
+            f,
+            "table_lookups_total",
+            "counter",
+            "Small-value table lookups by the scalar formatter.",
+        )?;
+        writeln!(f, "nconv_table_lookups_total {}", lookups)?;
+        header(
+            f,
+            "table_hits_total",
+            "counter",
+            "Small-value table lookups that hit.",
+        )?;
+        writeln!(f, "nconv_table_hits_total {}", hits)?;
+        header(
+            f,
+            "table_hit_ratio",
+            "gauge",
+            "Share of table lookups that hit.",
+        )?;
+        let ratio = match lookups {
+            0 => 0.0,
+            _ => hits as f64 / lookups as f64,
+        };
+        writeln!(f, "nconv_table_hit_ratio {:.6}", ratio)?;
+
+        header(
+            f,
+            "chunk_convert_seconds",
+            "histogram",
+            "Time to convert one input chunk.",
+        )?;
+        let mut cumulative = 0;
+        for (bound, count) in LATENCY_BUCKETS.iter().zip(&self.latency) {
+            cumulative += count;
+            writeln!(
+                f,
+                "nconv_chunk_convert_seconds_bucket{{le=\"{}\"}} {}",
+                bound, cumulative
+            )?;
+        }
+        cumulative += self.latency[LATENCY_BUCKETS.len()];
+        writeln!(
+            f,
+            "nconv_chunk_convert_seconds_bucket{{le=\"+Inf\"}} {}",
+            cumulative
+        )?;
+        writeln!(
+            f,
+            "nconv_chunk_convert_seconds_sum {:.9}",
+            self.latency_nanos as f64 / 1e9
+        )?;
+        writeln!(f, "nconv_chunk_convert_seconds_count {}", cumulative)?;
+
+        header(
+            f,
+            "last_update_timestamp_seconds",
+            "gauge",
+            "When these metrics were written.",
+        )?;
+        let time = self.time.duration_since(UNIX_EPOCH).unwrap_or_default();
+        writeln!(
+            f,
+            "nconv_last_update_timestamp_seconds {:.3}",
+            time.as_secs_f64()
+        )
+    }
+}
+
+/// Writes the current metrics to `path` atomically.
+///
+/// The metrics go to a hidden temporary file in the same directory first, which then replaces
+/// `path`, so that readers never see a partly written file.
+///
+/// # Arguments
+/// * `path` - The metrics file, e.g. `nconv.prom` in the textfile collector's directory.
+pub fn write_metrics(path: &Path) -> io::Result<()> {
+    let name = path.file_name().ok_or_else(|| {
+        io::Error::new(io::ErrorKind::InvalidInput, "metrics path has no file name")
+    })?;
+    let mut tmp_name = std::ffi::OsString::from(".");
+    tmp_name.push(name);
+    tmp_name.push(".tmp");
+    let tmp = path.with_file_name(tmp_name);
+
+    let mut file = std::fs::File::create(&tmp)?;
+    file.write_all(MetricsSnapshot::collect().to_string().as_bytes())?;
+    drop(file);
+    std::fs::rename(&tmp, path)
+}
+
+/// A background thread that writes the metrics file at a fixed interval.
+pub struct MetricsExporter {
+    path: PathBuf,
+    stop: Option<mpsc::Sender<()>>,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl MetricsExporter {
+    /// Enables metrics and starts writing them to `path` every `interval`.
+    ///
+    /// Failed periodic writes are retried at the next interval; [`MetricsExporter::finish`]
+    /// reports whether the final one succeeded.
+    ///
+    /// # Arguments
+    /// * `path` - The metrics file, see [`write_metrics`].
+    /// * `interval` - The time between two writes.
+    pub fn start(path: PathBuf, interval: Duration) -> MetricsExporter {
+        enable_metrics();
+        let (stop, stopped) = mpsc::channel();
+        let thread_path = path.clone();
+        let thread = std::thread::spawn(move || {
+            while let Err(mpsc::RecvTimeoutError::Timeout) = stopped.recv_timeout(interval) {
+                let _ = write_metrics(&thread_path);
+            }
+        });
+        MetricsExporter {
+            path,
+            stop: Some(stop),
+            thread: Some(thread),
+        }
+    }
+
+    /// Stops the periodic writes and writes the final metrics.
+    pub fn finish(mut self) -> io::Result<()> {
+        self.stop_thread();
+        write_metrics(&self.path)
+    }
+
+    fn stop_thread(&mut self) {
+        drop(self.stop.take());
+        if let Some(thread) = self.thread.take() {
+            let _ = thread.join();
+        }
+    }
+}
+
+impl Drop for MetricsExporter {
+    fn drop(&mut self) {
+        self.stop_thread();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn counts_of_exited_threads_are_kept_and_exported() {
+        enable_metrics();
+        let before = MetricsSnapshot::collect();
+        std::thread::spawn(|| {
+            count(Counter::Overflow, 3);
+            count(Counter::TableHits, 5);
+            observe_chunk(Some(Instant::now() - Duration::from_millis(2)));
+        })
+        .join()
+        .unwrap();
+        let after = MetricsSnapshot::collect();
+        assert!(after.get(Counter::Overflow) >= before.get(Counter::Overflow) + 3);
+        assert!(after.get(Counter::TableHits) >= before.get(Counter::TableHits) + 5);
+        assert!(after.latency.iter().sum::<u64>() > before.latency.iter().sum::<u64>());
+        assert!(after.latency_nanos >= before.latency_nanos + 2_000_000);
+
+        let path = std::env::temp_dir().join(format!("nconv-metrics-{}.prom", std::process::id()));
+        write_metrics(&path).unwrap();
+        let text = std::fs::read_to_string(&path).unwrap();
+        std::fs::remove_file(&path).unwrap();
+        assert!(text.contains("# TYPE nconv_chunk_convert_seconds histogram\n"));
+        assert!(text.contains("nconv_errors_total{kind=\"overflow\"} "));
+        assert!(text.contains("nconv_chunk_convert_seconds_bucket{le=\"+Inf\"} "));
+        assert!(text
+            .lines()
+            .filter(|line| !line.starts_with('#'))
+            .all(|line| line
+                .split(' ')
+                .nth(1)
+                .is_some_and(|v| v.parse::<f64>().is_ok())));
+    }
+}
@@ -0,0 +1,182 @@
+//! Multiplication of big integers stored as little-endian `u32` limbs.
+//!
+//! [`mul`] picks schoolbook multiplication for short factors, Karatsuba for medium ones and
+//! the NTT of [`crate::ntt`] for long ones. The crossover lengths are part of the
+//! [`Profile`](crate::Profile), so `nconv --tune` can measure them per machine.
+use std::cmp::Ordering;
+
+/// The factor lengths, in limbs, from which the faster multiplication algorithms take over.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct MulThresholds {
+    /// The shorter factor's length from which Karatsuba replaces schoolbook multiplication.
+    pub karatsuba: usize,
+    /// The shorter factor's length from which the NTT replaces Karatsuba.
+    pub ntt: usize,
+}
+
+impl Default for MulThresholds {
+    fn default() -> MulThresholds {
+        MulThresholds {
+            karatsuba: 32,
+            ntt: 1024,
+        }
+    }
+}
+
+/// Removes leading zero limbs.
+pub(crate) fn trim(limbs: &mut Vec<u32>) {
+    while limbs.last() == Some(&0) {
+        limbs.pop();
+    }
+}
+
+/// Returns `a` without its leading zero limbs.
+pub(crate) fn trimmed(a: &[u32]) -> &[u32] {
+    let len = a.iter().rposition(|&x| x != 0).map_or(0, |i| i + 1);
+    &a[..len]
+}
+
+/// Compares two limb slices by value.
+pub(crate) fn cmp(a: &[u32], b: &[u32]) -> Ordering {
+    let (a, b) = (trimmed(a), trimmed(b));
+    a.len()
+        .cmp(&b.len())
+        .then_with(|| a.iter().rev().cmp(b.iter().rev()))
+}
+
+/// Adds `b` into `a`, which must be long enough to hold the sum.
+pub(crate) fn add_into(a: &mut [u32], b: &[u32]) {
+    let mut carry = 0u64;
+    for (i, x) in a.iter_mut().enumerate() {
+        if i >= b.len() && carry == 0 {
+            return;
+        }
+        let sum = *x as u64 + b.get(i).copied().unwrap_or(0) as u64 + carry;
+        *x = sum as u32;
+        carry = sum >> 32;
+    }
+    debug_assert!(carry == 0, "sum does not fit");
+}
+
+/// Subtracts `b` from `a`, which must not be smaller.
+pub(crate) fn sub_into(a: &mut [u32], b: &[u32]) {
+    let mut borrow = 0i64;
+    for (i, x) in a.iter_mut().enumerate() {
+        if i >= b.len() && borrow == 0 {
+            return;
+        }
+        let diff = *x as i64 - b.get(i).copied().unwrap_or(0) as i64 - borrow;
+        *x = diff as u32;
+        borrow = (diff < 0) as i64;
+    }
+    debug_assert!(borrow == 0, "difference is negative");
+}
+
+/// Returns `a + b`.
+pub(crate) fn add(a: &[u32], b: &[u32]) -> Vec<u32> {
+    let (long, short) = if a.len() >= b.len() { (a, b) } else { (b, a) };
+    let mut sum = Vec::with_capacity(long.len() + 1);
+    sum.extend_from_slice(long);
+    sum.push(0);
+    add_into(&mut sum, short);
+    sum
+}
+
+/// Multiplies by schoolbook long multiplication.
+pub(crate) fn schoolbook(a: &[u32], b: &[u32]) -> Vec<u32> {
+    let mut product = vec![0u32; a.len() + b.len()];
+    for (i, &x) in a.iter().enumerate() {
+        let mut carry = 0u64;
+        for (j, &y) in b.iter().enumerate() {
+            let t = product[i + j] as u64 + x as u64 * y as u64 + carry;
+            product[i + j] = t as u32;
+            carry = t >> 32;
+        }
+        product[i + b.len()] = carry as u32;
+    }
+    product
+}
+
+/// Multiplies `a` by `b`, where `b` is at most as long as `a`, by splitting `a` into pieces
+/// as long as `b`.
+fn unbalanced(a: &[u32], b: &[u32], t: MulThresholds) -> Vec<u32> {
+    let mut product = vec![0u32; a.len() + b.len()];
+    for (i, piece) in a.chunks(b.len()).enumerate() {
+        let partial = mul(piece, b, t);
+        add_into(&mut product[i * b.len()..], trimmed(&partial));
+    }
+    product
+}
+
+/// Multiplies two factors of similar length with one level of Karatsuba recursion.
+fn karatsuba(a: &[u32], b: &[u32], t: MulThresholds) -> Vec<u32> {
+    let half = a.len().max(b.len()).div_ceil(2);
+    let (a0, a1) = a.split_at(half.min(a.len()));
+    let (b0, b1) = b.split_at(half.min(b.len()));
+
+    let z0 = mul(a0, b0, t);
+    let z2 = mul(a1, b1, t);
+    let (sa, sb) = (add(a0, a1), add(b0, b1));
+    let mut z1 = mul(trimmed(&sa), trimmed(&sb), t);
+    sub_into(&mut z1, &z0);
+    sub_into(&mut z1, &z2);
+
+    let mut product = vec![0u32; a.len() + b.len()];
+    product[..z0.len()].copy_from_slice(&z0);
+    add_into(&mut product[2 * half..], trimmed(&z2));
+    add_into(&mut product[half..], trimmed(&z1));
+    product
+}
+
+/// Multiplies two little-endian limb slices.
+///
+/// # Returns
+/// The `a.len() + b.len()` limbs of the product, possibly with leading zeros.
+pub(crate) fn mul(a: &[u32], b: &[u32], t: MulThresholds) -> Vec<u32> {
+    let (a, b) = if a.len() >= b.len() { (a, b) } else { (b, a) };
+    // Below four limbs the Karatsuba sums are as long as the factors.
+    if b.len() < t.karatsuba.max(4) {
+        return schoolbook(a, b);
+    }
+    if b.len() >= t.ntt && a.len() + b.len() <= crate::ntt::MAX_LEN {
+        return crate::ntt::mul(a, b);
+    }
+    if a.len() >= 2 * b.len() {
+        return unbalanced(a, b, t);
+    }
+    karatsuba(a, b, t)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::testing::XorShift;
+
+    #[test]
+    fn every_algorithm_gives_the_same_product() {
+        let mut rng = XorShift::new(0x2545_F491);
+        // Runs of all-ones limbs push every carry path.
+        let mut limbs = |n: usize| -> Vec<u32> {
+            let mut limbs = rng.limbs(n);
+            limbs
+                .iter_mut()
+                .step_by(7)
+                .for_each(|limb| *limb = u32::MAX);
+            limbs
+        };
+        let karatsuba_only = MulThresholds {
+            karatsuba: 2,
+            ntt: usize::MAX,
+        };
+        let ntt_only = MulThresholds {
+            karatsuba: 2,
+            ntt: 2,
+        };
+        for (m, n) in [(1, 1), (2, 3), (17, 40), (64, 64), (300, 31), (999, 1000)] {
+            let (a, b) = (limbs(m), limbs(n));
+            let expected = schoolbook(&a, &b);
+            assert_eq!(mul(&a, &b, karatsuba_only), expected, "{}x{}", m, n);
+            assert_eq!(mul(&a, &b, ntt_only), expected, "{}x{}", m, n);
+        }
+    }
+}
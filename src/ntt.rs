@@ -0,0 +1,182 @@
+//! Multiplication of big integers with number-theoretic transforms.
+//!
+//! The limbs of both factors are convolved modulo three NTT-friendly primes, each in its own
+//! thread, and the exact coefficients are recovered with the Chinese remainder theorem. All
+//! arithmetic is on integers, so unlike a floating-point FFT there is no rounding error to
+//! bound: a coefficient is a sum of at most [`MAX_LEN`] products of two 32-bit limbs, which
+//! stays below the product of the primes.
+
+/// The longest convolution the primes support, `2^26` limbs of result.
+pub(crate) const MAX_LEN: usize = 1 << 26;
+
+/// Transforms of at least this length run the three primes in parallel.
+const PARALLEL_MIN_LEN: usize = 1 << 14;
+
+const P1: u32 = 469_762_049; // 7 * 2^26 + 1
+const P2: u32 = 1_811_939_329; // 27 * 2^26 + 1
+const P3: u32 = 2_013_265_921; // 15 * 2^27 + 1
+
+const fn pow_mod(base: u32, mut exp: u64, p: u32) -> u32 {
+    let (mut base, mut result) = (base as u64 % p as u64, 1u64);
+    while exp > 0 {
+        if exp & 1 == 1 {
+            result = result * base % p as u64;
+        }
+        base = base * base % p as u64;
+        exp >>= 1;
+    }
+    result as u32
+}
+
+const fn inverse(a: u32, p: u32) -> u32 {
+    pow_mod(a, p as u64 - 2, p)
+}
+
+#[inline]
+fn mul_mod<const P: u32>(a: u32, b: u32) -> u32 {
+    (a as u64 * b as u64 % P as u64) as u32
+}
+
+/// Transforms `a` in place; its length must be a power of two dividing `P - 1`.
+///
+/// `G` is a primitive root modulo `P`. The inverse transform leaves out the division by the
+/// length.
+fn transform<const P: u32, const G: u32>(a: &mut [u32], inverse_transform: bool) {
+    let n = a.len();
+    let mut j = 0;
+    for i in 1..n {
+        let mut bit = n >> 1;
+        while j & bit != 0 {
+            j ^= bit;
+            bit >>= 1;
+        }
+        j |= bit;
+        if i < j {
+            a.swap(i, j);
+        }
+    }
+
+    // roots[half + k] is the k-th power of a primitive (2 * half)-th root of unity.
+    let mut roots = vec![0u32; n.max(2)];
+    let mut half = 1;
+    while half < n {
+        let mut w = pow_mod(G, (P as u64 - 1) / (2 * half) as u64, P);
+        if inverse_transform {
+            w = inverse(w, P);
+        }
+        roots[half] = 1;
+        for k in 1..half {
+            roots[half + k] = mul_mod::<P>(roots[half + k - 1], w);
+        }
+        half <<= 1;
+    }
+
+    let mut half = 1;
+    while half < n {
+        let stage_roots = &roots[half..2 * half];
+        for block in a.chunks_exact_mut(2 * half) {
+            let (lo, hi) = block.split_at_mut(half);
+            for ((x, y), &w) in lo.iter_mut().zip(hi.iter_mut()).zip(stage_roots) {
+                let u = *x;
+                let v = mul_mod::<P>(*y, w);
+                *x = if u + v >= P { u + v - P } else { u + v };
+                *y = if u >= v { u - v } else { u + P - v };
+            }
+        }
+        half <<= 1;
+    }
+}
+
+/// Returns the cyclic convolution of `a` and `b` modulo `P`, of length `n`.
+fn convolve<const P: u32, const G: u32>(a: &[u32], b: &[u32], n: usize) -> Vec<u32> {
+    let reduce = |limbs: &[u32]| {
+        let mut v: Vec<u32> = limbs.iter().map(|&x| x % P).collect();
+        v.resize(n, 0);
+        v
+    };
+    let mut fa = reduce(a);
+    transform::<P, G>(&mut fa, false);
+    if std::ptr::eq(a, b) {
+        fa.iter_mut().for_each(|x| *x = mul_mod::<P>(*x, *x));
+    } else {
+        let mut fb = reduce(b);
+        transform::<P, G>(&mut fb, false);
+        fa.iter_mut()
+            .zip(&fb)
+            .for_each(|(x, &y)| *x = mul_mod::<P>(*x, y));
+    }
+    transform::<P, G>(&mut fa, true);
+    let scale = inverse(n as u32, P);
+    fa.iter_mut().for_each(|x| *x = mul_mod::<P>(*x, scale));
+    fa
+}
+
+/// Multiplies two little-endian limb slices with three-prime NTTs.
+///
+/// # Returns
+/// The `a.len() + b.len()` limbs of the product.
+///
+/// # Panics
+/// If the product has more than [`MAX_LEN`] limbs.
+pub(crate) fn mul(a: &[u32], b: &[u32]) -> Vec<u32> {
+    let len = a.len() + b.len();
+    assert!(
+        len <= MAX_LEN,
+        "product of {} limbs is too long for the NTT",
+        len
+    );
+    let n = len.next_power_of_two();
+
+    let (r1, r2, r3) = if n >= PARALLEL_MIN_LEN {
+        std::thread::scope(|s| {
+            let r2 = s.spawn(|| convolve::<P2, 13>(a, b, n));
+            let r3 = s.spawn(|| convolve::<P3, 31>(a, b, n));
+            let r1 = convolve::<P1, 3>(a, b, n);
+            (
+                r1,
+                r2.join().expect("NTT panicked"),
+                r3.join().expect("NTT panicked"),
+            )
+        })
+    } else {
+        (
+            convolve::<P1, 3>(a, b, n),
+            convolve::<P2, 13>(a, b, n),
+            convolve::<P3, 31>(a, b, n),
+        )
+    };
+
+    // Garner's algorithm: x = x1 + P1 * x2 + P1 * P2 * x3 with each digit below its prime.
+    const P1_INV_P2: u32 = inverse(P1 % P2, P2);
+    const P1_INV_P3: u32 = inverse(P1 % P3, P3);
+    const P2_INV_P3: u32 = inverse(P2 % P3, P3);
+    let mut product = Vec::with_capacity(len);
+    let mut carry = 0u128;
+    for i in 0..len {
+        let x1 = r1[i];
+        let x2 = mul_mod::<P2>((r2[i] + P2 - x1 % P2) % P2, P1_INV_P2);
+        let t = mul_mod::<P3>((r3[i] + P3 - x1 % P3) % P3, P1_INV_P3);
+        let x3 = mul_mod::<P3>((t + P3 - x2 % P3) % P3, P2_INV_P3);
+        carry += x1 as u128 + P1 as u128 * x2 as u128 + (P1 as u128 * P2 as u128) * x3 as u128;
+        product.push(carry as u32);
+        carry >>= 32;
+    }
+    product
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::testing::XorShift;
+
+    #[test]
+    fn ntt_matches_schoolbook_including_worst_case_limbs() {
+        let mut rng = XorShift::new(0x9E37_79B9);
+        for (m, n) in [(1, 1), (3, 7), (100, 100), (513, 77), (2000, 3000)] {
+            let (a, b) = (rng.limbs(m), rng.limbs(n));
+            assert_eq!(mul(&a, &b), crate::mul::schoolbook(&a, &b), "{}x{}", m, n);
+        }
+        let max = vec![u32::MAX; 5000];
+        assert_eq!(mul(&max, &max), crate::mul::schoolbook(&max, &max));
+    }
+}
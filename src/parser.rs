@@ -0,0 +1,474 @@
+//! A resumable, push-based number parser.
+//!
+//! [`Parser`] accepts the digits of a single number in arbitrarily split chunks, so a number
+//! that straddles read buffers never has to be reassembled into one string first. Prefix and
+//! digit validation work across chunk boundaries, and digits are folded into the value
+//! directly from the caller's buffers.
+use crate::{ConversionError, NumSystem};
+
+/// Marks bytes that are not digits in any supported base.
+const INVALID: u8 = 0xFF;
+
+/// Maps every byte to its digit value, or [`INVALID`].
+pub(crate) static DIGIT_VALUES: [u8; 256] = {
+    let mut table = [INVALID; 256];
+    let mut i = 0;
+    while i < 10 {
+        table[b'0' as usize + i] = i as u8;
+        i += 1;
+    }
+    let mut i = 0;
+    while i < 6 {
+        table[b'A' as usize + i] = 10 + i as u8;
+        table[b'a' as usize + i] = 10 + i as u8;
+        i += 1;
+    }
+    table
+};
+
+/// Returns how many digits of `base` always fit in a `u64`, and `base` raised to that count.
+pub(crate) const fn chunk_digits(base: NumSystem) -> (usize, u128) {
+    match base {
+        NumSystem::Bin => (64, 1 << 64),
+        NumSystem::Oct => (21, 1 << 63),
+        NumSystem::Dec => (19, 10_000_000_000_000_000_000),
+        NumSystem::Hex => (16, 1 << 64),
+    }
+}
+
+/// A set of ASCII bytes that may appear between digits and are skipped by the parser.
+///
+/// This lets grouped output such as `DEAD BEEF` and source-code literals such as
+/// `0xDEAD_BEEF` be parsed directly. Bytes that are digits in any supported base are never
+/// treated as separators.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct Separators([u64; 2]);
+
+impl Separators {
+    /// Creates a separator set from a list of ASCII bytes. Non-ASCII bytes are ignored.
+    ///
+    /// # Examples
+    ///
+    /// ```
+    /// use nconv::Separators;
+    ///
+    /// let separators = Separators::new(b" _");
+    /// assert!(separators.contains(b'_'));
+    /// assert!(!separators.contains(b'A'));
+    /// ```
+    pub fn new(bytes: &[u8]) -> Separators {
+        let mut set = [0u64; 2];
+        for &b in bytes {
+            if b.is_ascii() && DIGIT_VALUES[b as usize] == INVALID {
+                set[b as usize / 64] |= 1 << (b % 64);
+            }
+        }
+        Separators(set)
+    }
+
+    /// Returns the empty separator set.
+    pub fn none() -> Separators {
+        Separators::default()
+    }
+
+    /// Returns whether `b` is a separator.
+    pub fn contains(&self, b: u8) -> bool {
+        b.is_ascii() && self.0[b as usize / 64] & (1 << (b % 64)) != 0
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq)]
+enum State {
+    /// Nothing has been fed yet.
+    Start,
+    /// Only a leading `0` has been seen, which may still start a prefix.
+    LeadingZero,
+    /// Any prefix has been handled and only digits may follow.
+    Digits,
+    /// Parsing failed; the error is sticky.
+    Failed(ConversionError),
+}
+
+/// A resumable parser for a single number fed in chunks.
+///
+/// The parser follows the same rules as [`convert_base`](crate::convert_base): an optional
+/// `0b`/`0o`/`0x` prefix matching the source base, followed by digits of that base, with the
+/// value limited to 128 bits. A parser created with [`Parser::with_separators`] additionally
+/// skips separator bytes anywhere after the prefix.
+///
+/// # Examples
+///
+/// ```
+/// use nconv::{NumSystem, Parser};
+///
+/// let mut parser = Parser::new(NumSystem::Hex);
+/// parser.feed(b"0").unwrap();
+/// parser.feed(b"xDEAD").unwrap();
+/// parser.feed(b"BEEF").unwrap();
+/// assert_eq!(parser.finish().unwrap(), 0xDEADBEEF);
+/// ```
+#[derive(Debug, Clone)]
+pub struct Parser {
+    base: NumSystem,
+    separators: Separators,
+    value: u128,
+    state: State,
+    offset: usize,
+}
+
+impl Parser {
+    /// Creates a parser for a number in the `base` number system.
+    pub fn new(base: NumSystem) -> Parser {
+        Parser::with_separators(base, Separators::none())
+    }
+
+    /// Creates a parser for a number in the `base` number system that skips `separators`.
+    pub fn with_separators(base: NumSystem, separators: Separators) -> Parser {
+        Parser {
+            base,
+            separators,
+            value: 0,
+            state: State::Start,
+            offset: 0,
+        }
+    }
+
+    /// Feeds the next chunk of the number to the parser.
+    ///
+    /// # Arguments
+    /// * `chunk` - The next bytes of the number. May be empty.
+    ///
+    /// # Returns
+    /// * `Ok(())` - If the number is still valid after this chunk.
+    /// * `Err(ConversionError)` - If this or an earlier chunk made the number invalid. The
+    ///   error is sticky: later calls to `feed` and `finish` return it again.
+    pub fn feed(&mut self, chunk: &[u8]) -> Result<(), ConversionError> {
+        let mut rest = chunk;
+        while !rest.is_empty() {
+            match self.state {
+                State::Start => {
+                    if rest[0] == b'0' {
+                        self.state = State::LeadingZero;
+                        self.offset += 1;
+                        rest = &rest[1..];
+                    } else {
+                        self.state = State::Digits;
+                    }
+                }
+                State::LeadingZero => {
+                    let prefix_base = match rest[0].to_ascii_lowercase() {
+                        b'x' => Some(NumSystem::Hex),
+                        b'o' => Some(NumSystem::Oct),
+                        b'b' => Some(NumSystem::Bin),
+                        _ => None,
+                    };
+                    self.state = State::Digits;
+                    match prefix_base {
+                        Some(base) if base == self.base => {
+                            self.offset += 1;
+                            rest = &rest[1..];
+                        }
+                        Some(_) => return Err(self.fail(ConversionError::InvalidBase)),
+                        None => (),
+                    }
+                }
+                State::Digits => {
+                    self.feed_digits(rest)?;
+                    rest = &[];
+                }
+                State::Failed(e) => return Err(e),
+            }
+        }
+
+        match self.state {
+            State::Failed(e) => Err(e),
+            _ => Ok(()),
+        }
+    }
+
+    /// Completes parsing and returns the value of the number.
+    ///
+    /// An empty input, or a bare prefix, parses as zero.
+    ///
+    /// # Returns
+    /// * `Ok(u128)` - The value of the number.
+    /// * `Err(ConversionError)` - If any fed chunk made the number invalid.
+    pub fn finish(self) -> Result<u128, ConversionError> {
+        match self.state {
+            State::Failed(e) => Err(e),
+            _ => Ok(self.value),
+        }
+    }
+
+    /// Returns the number of bytes consumed so far.
+    ///
+    /// After an error this is the offset of the offending byte: the invalid digit, the
+    /// mismatched prefix letter, or the digit at which the value overflowed.
+    pub fn offset(&self) -> usize {
+        self.offset
+    }
+
+    fn fail(&mut self, e: ConversionError) -> ConversionError {
+        self.state = State::Failed(e);
+        e
+    }
+
+    /// Folds digits into the value, one `u64`-sized run at a time.
+    ///
+    /// Separator bytes are skipped in the same pass, without copying the digits.
+    fn feed_digits(&mut self, digits: &[u8]) -> Result<(), ConversionError> {
+        let base = self.base as u8;
+        let (run_len, run_scale) = chunk_digits(self.base);
+
+        let mut acc = 0u64;
+        let mut count = 0;
+        let mut run_start = 0;
+        for (i, &b) in digits.iter().enumerate() {
+            let d = DIGIT_VALUES[b as usize];
+            if d >= base {
+                if self.separators.contains(b) {
+                    continue;
+                }
+                self.fold_run(acc, count, &digits[run_start..i])?;
+                self.offset += i - run_start;
+                return Err(self.fail(ConversionError::InvalidDigit(byte_char(b))));
+            }
+
+            acc = acc.wrapping_mul(base as u64) + d as u64;
+            count += 1;
+            if count == run_len {
+                match self
+                    .value
+                    .checked_mul(run_scale)
+                    .and_then(|v| v.checked_add(acc as u128))
+                {
+                    Some(v) => self.value = v,
+                    None => return Err(self.overflow_in(&digits[run_start..=i])),
+                }
+                self.offset += i + 1 - run_start;
+                run_start = i + 1;
+                acc = 0;
+                count = 0;
+            }
+        }
+
+        self.fold_run(acc, count, &digits[run_start..])?;
+        self.offset += digits.len() - run_start;
+        Ok(())
+    }
+
+    /// Folds a partial run of `count` digits with value `acc` into the value.
+    fn fold_run(&mut self, acc: u64, count: usize, run: &[u8]) -> Result<(), ConversionError> {
+        let scale = (self.base as u128).pow(count as u32);
+        match self
+            .value
+            .checked_mul(scale)
+            .and_then(|v| v.checked_add(acc as u128))
+        {
+            Some(v) => {
+                self.value = v;
+                Ok(())
+            }
+            None => Err(self.overflow_in(run)),
+        }
+    }
+
+    /// Replays a run that overflowed digit by digit to find the offending offset.
+    fn overflow_in(&mut self, run: &[u8]) -> ConversionError {
+        let base = self.base as u128;
+        for &b in run {
+            let d = DIGIT_VALUES[b as usize] as u128;
+            if d < base {
+                match self.value.checked_mul(base).and_then(|v| v.checked_add(d)) {
+                    Some(v) => self.value = v,
+                    None => break,
+                }
+            }
+            self.offset += 1;
+        }
+        self.fail(ConversionError::NumberOverflow)
+    }
+}
+
+/// Returns the character for an offending byte, or U+FFFD for a non-ASCII byte.
+pub(crate) fn byte_char(b: u8) -> char {
+    if b.is_ascii() {
+        b as char
+    } else {
+        char::REPLACEMENT_CHARACTER
+    }
+}
+
+/// Parses a complete number in the `src` number system.
+///
+/// # Arguments
+/// * `num` - The number, with an optional prefix matching `src`.
+/// * `src` - The number system of `num`.
+///
+/// # Returns
+/// * `Ok(u128)` - The value of the number.
+/// * `Err(ConversionError)` - If the number is invalid. An invalid digit is reported as the
+///   full character found in `num`, even when it is not ASCII.
+///
+/// # Examples
+///
+/// ```
+/// use nconv::{parse_value, NumSystem};
+///
+/// assert_eq!(parse_value("0o777", NumSystem::Oct).unwrap(), 511);
+/// ```
+pub fn parse_value(num: &str, src: NumSystem) -> Result<u128, ConversionError> {
+    parse_value_with_separators(num, src, Separators::none())
+}
+
+/// Parses a complete number in the `src` number system, skipping `separators` between digits.
+///
+/// # Examples
+///
+/// ```
+/// use nconv::{parse_value_with_separators, NumSystem, Separators};
+///
+/// let separators = Separators::new(b" _");
+/// let value = parse_value_with_separators("0xDEAD_BEEF", NumSystem::Hex, separators);
+/// assert_eq!(value.unwrap(), 0xDEADBEEF);
+/// ```
+pub fn parse_value_with_separators(
+    num: &str,
+    src: NumSystem,
+    separators: Separators,
+) -> Result<u128, ConversionError> {
+    let mut parser = Parser::with_separators(src, separators);
+    match parser.feed(num.as_bytes()) {
+        Err(ConversionError::InvalidDigit(_)) => {
+            // The offending byte starts a character: everything before it was ASCII.
+            let c = num[parser.offset()..].chars().next().unwrap_or('\u{FFFD}');
+            Err(ConversionError::InvalidDigit(c))
+        }
+        Err(e) => Err(e),
+        Ok(()) => parser.finish(),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Feeds `num` split at every possible position and checks all splits agree.
+    fn parse_split(num: &str, base: NumSystem) -> Result<u128, ConversionError> {
+        let expected = parse_value(num, base);
+        for split in 0..=num.len() {
+            let mut parser = Parser::new(base);
+            let _ = parser.feed(&num.as_bytes()[..split]);
+            let _ = parser.feed(&num.as_bytes()[split..]);
+            assert_eq!(parser.finish(), expected, "split {} of {:?}", split, num);
+        }
+        expected
+    }
+
+    #[test]
+    fn parser_handles_prefixes_split_across_chunks() {
+        assert_eq!(parse_split("0xDEADBEEF", NumSystem::Hex), Ok(0xDEADBEEF));
+        assert_eq!(parse_split("0B1010", NumSystem::Bin), Ok(10));
+        assert_eq!(parse_split("0o777", NumSystem::Oct), Ok(511));
+        assert_eq!(parse_split("0", NumSystem::Dec), Ok(0));
+        assert_eq!(parse_split("007", NumSystem::Dec), Ok(7));
+        assert_eq!(parse_split("", NumSystem::Dec), Ok(0));
+    }
+
+    #[test]
+    fn parser_reports_errors_across_chunks() {
+        assert_eq!(
+            parse_split("0x12", NumSystem::Dec),
+            Err(ConversionError::InvalidBase)
+        );
+        assert_eq!(
+            parse_split("0b12", NumSystem::Bin),
+            Err(ConversionError::InvalidDigit('2'))
+        );
+        assert_eq!(
+            parse_split("12 34", NumSystem::Dec),
+            Err(ConversionError::InvalidDigit(' '))
+        );
+        assert_eq!(
+            parse_split(&"F".repeat(33), NumSystem::Hex),
+            Err(ConversionError::NumberOverflow)
+        );
+    }
+
+    #[test]
+    fn parser_accepts_values_at_the_128_bit_limit() {
+        assert_eq!(parse_split(&"1".repeat(128), NumSystem::Bin), Ok(u128::MAX));
+        assert_eq!(
+            parse_split(&u128::MAX.to_string(), NumSystem::Dec),
+            Ok(u128::MAX)
+        );
+        assert_eq!(
+            parse_split("340282366920938463463374607431768211456", NumSystem::Dec),
+            Err(ConversionError::NumberOverflow)
+        );
+    }
+
+    #[test]
+    fn parser_records_offset_of_offending_byte() {
+        let mut parser = Parser::new(NumSystem::Dec);
+        parser.feed(b"123").unwrap();
+        assert!(parser.feed(b"4x5").is_err());
+        assert_eq!(parser.offset(), 4);
+
+        let mut parser = Parser::new(NumSystem::Bin);
+        assert!(parser.feed("1".repeat(130).as_bytes()).is_err());
+        assert_eq!(parser.offset(), 128);
+    }
+
+    #[test]
+    fn parser_skips_separators_across_chunks() {
+        let separators = Separators::new(b" _");
+        let parse = |num: &str, base| {
+            let expected = parse_value_with_separators(num, base, separators);
+            for split in 0..=num.len() {
+                let mut parser = Parser::with_separators(base, separators);
+                let _ = parser.feed(&num.as_bytes()[..split]);
+                let _ = parser.feed(&num.as_bytes()[split..]);
+                assert_eq!(parser.finish(), expected, "split {} of {:?}", split, num);
+            }
+            expected
+        };
+
+        assert_eq!(parse("DEAD BEEF", NumSystem::Hex), Ok(0xDEADBEEF));
+        assert_eq!(parse("0xDEAD_BEEF", NumSystem::Hex), Ok(0xDEADBEEF));
+        assert_eq!(parse("1 234 567", NumSystem::Dec), Ok(1234567));
+        assert_eq!(parse(&"1111 ".repeat(32), NumSystem::Bin), Ok(u128::MAX));
+        assert_eq!(
+            parse(&"1111 ".repeat(33), NumSystem::Bin),
+            Err(ConversionError::NumberOverflow)
+        );
+        assert_eq!(
+            parse("12-34", NumSystem::Dec),
+            Err(ConversionError::InvalidDigit('-'))
+        );
+        assert_eq!(
+            parse("0_x12", NumSystem::Hex),
+            Err(ConversionError::InvalidDigit('x'))
+        );
+    }
+
+    #[test]
+    fn separators_never_include_digits() {
+        let separators = Separators::new(b"aF_");
+        assert!(!separators.contains(b'a'));
+        assert!(!separators.contains(b'F'));
+        assert!(separators.contains(b'_'));
+        assert_eq!(
+            parse_value("12_3", NumSystem::Dec),
+            Err(ConversionError::InvalidDigit('_'))
+        );
+    }
+
+    #[test]
+    fn parse_value_reports_non_ascii_digits() {
+        assert_eq!(
+            parse_value("12é", NumSystem::Dec),
+            Err(ConversionError::InvalidDigit('é'))
+        );
+    }
+}
@@ -0,0 +1,395 @@
+//! Reusable conversion plans.
+//!
+//! A [`ConversionPlan`] captures everything needed to turn input numbers into output text
+//! (source and target base, separators, padding and grouping) once, so that batches of
+//! numbers can be converted without re-reading the configuration or allocating a string
+//! per step.
+use crate::big::DigitSink;
+use crate::{
+    current_profile, parse_value_with_separators, small_table, BigUint, Config, ConversionError,
+    Kernels, NumSystem, Parser, Separators,
+};
+use std::io::{self, Write};
+
+/// The size of the blocks in which [`ConversionPlan::convert_big_to`] writes its output.
+const STREAM_BLOCK: usize = 1 << 16;
+
+/// A fixed recipe for converting numbers between two number systems.
+#[derive(Debug, Clone, Copy)]
+pub struct ConversionPlan {
+    /// The source number system.
+    pub src_base: NumSystem,
+    /// The target number system.
+    pub tgt_base: NumSystem,
+    /// The size of digit grouping (0 for no grouping).
+    pub grouping: u32,
+    /// The minimum width for zero-padding the output.
+    pub width: u32,
+    /// Bytes skipped between the digits of input numbers.
+    pub separators: Separators,
+    /// The parse and format kernels, taken from the [`current_profile`] for this pair.
+    pub kernels: Kernels,
+}
+
+impl ConversionPlan {
+    pub fn new(
+        src_base: NumSystem,
+        tgt_base: NumSystem,
+        grouping: u32,
+        width: u32,
+        separators: Separators,
+    ) -> ConversionPlan {
+        ConversionPlan {
+            src_base,
+            tgt_base,
+            grouping,
+            width,
+            separators,
+            kernels: current_profile().get(src_base, tgt_base),
+        }
+    }
+
+    /// Creates the plan described by a [`Config`].
+    pub fn from_config(config: &Config) -> ConversionPlan {
+        ConversionPlan::new(
+            config.src_base,
+            config.tgt_base,
+            config.grouping,
+            config.width,
+            config.separators,
+        )
+    }
+
+    /// Parses a number in the plan's source number system.
+    pub fn parse(&self, num: &str) -> Result<u128, ConversionError> {
+        parse_value_with_separators(num, self.src_base, self.separators)
+    }
+
+    /// Parses a number given as raw bytes, e.g. a token of an input file.
+    pub fn parse_bytes(&self, num: &[u8]) -> Result<u128, ConversionError> {
+        if let Some(value) = self.kernels.parse_fast(num, self.src_base) {
+            return Ok(value);
+        }
+        let mut parser = Parser::with_separators(self.src_base, self.separators);
+        parser.feed(num)?;
+        parser.finish()
+    }
+
+    /// Appends the padded and grouped digits of `value` to `out`.
+    ///
+    /// The result is identical to applying [`pad_width`](crate::pad_width) and then
+    /// [`group_digits`](crate::group_digits) to the digits of `value`, but is written in a
+    /// single pass without intermediate strings.
+    pub fn format_into(&self, value: u128, out: &mut Vec<u8>) {
+        let mut buf = [0u8; 128];
+        let cached = match self.kernels.table {
+            true => small_table(self.tgt_base).get(value),
+            false => None,
+        };
+        let digits = match cached {
+            Some(digits) => digits.as_bytes(),
+            None => self.kernels.format(value, self.tgt_base, &mut buf),
+        };
+        self.layout(digits, out);
+    }
+
+    /// Parses a number of any length and writes its padded and grouped digits to `out`.
+    ///
+    /// This is the arbitrary-precision counterpart of [`ConversionPlan::parse_bytes`] and
+    /// [`ConversionPlan::format_into`], built on [`BigUint`]. Digits are written in blocks as
+    /// soon as they are final, so besides the parsed number only a bounded buffer of text is
+    /// held in memory, however long the output.
+    ///
+    /// # Returns
+    /// * `Ok(())` - If the number was converted and written.
+    /// * `Err(ConversionError)` - If the number is invalid, before anything is written, or
+    ///   [`ConversionError::Output`] if writing failed.
+    ///
+    /// # Examples
+    ///
+    /// ```
+    /// use nconv::{ConversionPlan, NumSystem, Separators};
+    ///
+    /// let plan = ConversionPlan::new(NumSystem::Hex, NumSystem::Dec, 3, 1, Separators::none());
+    /// let mut out = Vec::new();
+    /// plan.convert_big_to(b"100000000000000000000000000000000", &mut out).unwrap();
+    /// assert_eq!(out, b"340 282 366 920 938 463 463 374 607 431 768 211 456");
+    ///
+    /// let plan = ConversionPlan::new(NumSystem::Dec, NumSystem::Bin, 8, 24, Separators::none());
+    /// let mut out = std::io::Cursor::new(Vec::new());
+    /// plan.convert_big_to(b"1234567", &mut out).unwrap();
+    /// assert_eq!(out.into_inner(), b"00010010 11010110 10000111");
+    /// ```
+    pub fn convert_big_to(&self, num: &[u8], out: &mut dyn Write) -> Result<(), ConversionError> {
+        let value = BigUint::parse(num, self.src_base, self.separators)?;
+        let mut writer = LayoutWriter::new(self, out);
+        value
+            .write_digits(self.tgt_base, &mut writer)
+            .and_then(|()| writer.flush())
+            .map_err(|e| ConversionError::Output(e.kind()))
+    }
+
+    /// Converts a batch of tokens, appending each converted number and a newline to `out`.
+    ///
+    /// With [`Kernels::lanes`] set, tokens of equal length are converted several at a time
+    /// by lane-parallel kernels; the output is the same either way.
+    ///
+    /// # Arguments
+    /// * `tokens` - The numbers to convert, e.g. the tokens of an input buffer.
+    /// * `out` - Receives one line per converted token, in token order.
+    /// * `on_error` - Called with the index and error of every token that failed, in order.
+    ///
+    /// # Returns
+    /// The number of converted tokens.
+    ///
+    /// # Examples
+    ///
+    /// ```
+    /// use nconv::{ConversionPlan, NumSystem, Separators};
+    ///
+    /// let plan = ConversionPlan::new(NumSystem::Dec, NumSystem::Hex, 0, 4, Separators::none());
+    /// let mut out = Vec::new();
+    /// let tokens: [&[u8]; 3] = [b"255", b"x", b"4096"];
+    /// let converted = plan.convert_tokens(&tokens, &mut out, &mut |i, e| assert_eq!(i, 1));
+    /// assert_eq!((converted, out.as_slice()), (2, &b"00FF\n1000\n"[..]));
+    /// ```
+    pub fn convert_tokens(
+        &self,
+        tokens: &[&[u8]],
+        out: &mut Vec<u8>,
+        on_error: &mut dyn FnMut(usize, ConversionError),
+    ) -> usize {
+        if self.kernels.lanes {
+            return crate::lanes::convert_tokens(self, tokens, out, on_error);
+        }
+        let mut converted = 0;
+        for (i, token) in tokens.iter().enumerate() {
+            match self.parse_bytes(token) {
+                Ok(value) => {
+                    self.format_into(value, out);
+                    out.push(b'\n');
+                    converted += 1;
+                }
+                Err(error) => on_error(i, error),
+            }
+        }
+        converted
+    }
+
+    /// Appends `digits` zero-padded to the plan's width and grouped.
+    pub(crate) fn layout(&self, digits: &[u8], out: &mut Vec<u8>) {
+        let pad = (self.width as usize).saturating_sub(digits.len());
+        if self.grouping == 0 {
+            out.extend(std::iter::repeat_n(b'0', pad));
+            out.extend_from_slice(digits);
+            return;
+        }
+
+        let group = self.grouping as usize;
+        let total = pad + digits.len();
+        out.reserve(total + total / group);
+        let mut left_in_group = match total % group {
+            0 => group,
+            n => n,
+        };
+        for i in 0..total {
+            if left_in_group == 0 {
+                out.push(b' ');
+                left_in_group = group;
+            }
+            out.push(if i < pad { b'0' } else { digits[i - pad] });
+            left_in_group -= 1;
+        }
+    }
+
+    /// Estimates how many output bytes one byte of input becomes, ignoring zero-padding.
+    pub(crate) fn output_ratio(&self) -> f64 {
+        let digits = (self.src_base as u32 as f64).ln() / (self.tgt_base as u32 as f64).ln();
+        // Every token also keeps one byte for its separator, which becomes a newline.
+        let digits = digits.max(1.0);
+        match self.grouping {
+            0 => digits,
+            g => digits * (1.0 + 1.0 / g as f64),
+        }
+    }
+
+    /// Converts a number string according to the plan.
+    ///
+    /// # Examples
+    ///
+    /// ```
+    /// use nconv::{ConversionPlan, NumSystem, Separators};
+    ///
+    /// let plan = ConversionPlan::new(NumSystem::Dec, NumSystem::Hex, 4, 12, Separators::none());
+    /// assert_eq!(plan.convert("3735928559").unwrap(), "0000 DEAD BEEF");
+    /// ```
+    pub fn convert(&self, num: &str) -> Result<String, ConversionError> {
+        let mut out = Vec::new();
+        self.format_into(self.parse(num)?, &mut out);
+        Ok(out.into_iter().map(char::from).collect())
+    }
+}
+
+/// Applies a plan's padding and grouping to digits that arrive in blocks, and writes the
+/// result in blocks of [`STREAM_BLOCK`] bytes.
+struct LayoutWriter<'a> {
+    out: &'a mut dyn Write,
+    buf: Vec<u8>,
+    width: u64,
+    group: usize,
+    /// The digits left before the next group separator.
+    left_in_group: usize,
+}
+
+impl LayoutWriter<'_> {
+    fn new<'a>(plan: &ConversionPlan, out: &'a mut dyn Write) -> LayoutWriter<'a> {
+        LayoutWriter {
+            out,
+            buf: Vec::with_capacity(STREAM_BLOCK + 128),
+            width: plan.width as u64,
+            group: plan.grouping as usize,
+            left_in_group: 0,
+        }
+    }
+
+    /// Writes out the buffered text.
+    fn flush(&mut self) -> io::Result<()> {
+        self.out.write_all(&self.buf)?;
+        self.buf.clear();
+        Ok(())
+    }
+}
+
+impl DigitSink for LayoutWriter<'_> {
+    fn begin(&mut self, len: u64) -> io::Result<()> {
+        let pad = self.width.saturating_sub(len);
+        if self.group > 0 {
+            self.left_in_group = match ((pad + len) % self.group as u64) as usize {
+                0 => self.group,
+                n => n,
+            };
+        }
+        let zeros = [b'0'; 64];
+        for start in (0..pad).step_by(zeros.len()) {
+            self.push(&zeros[..(pad - start).min(zeros.len() as u64) as usize])?;
+        }
+        Ok(())
+    }
+
+    fn push(&mut self, digits: &[u8]) -> io::Result<()> {
+        for block in digits.chunks(STREAM_BLOCK) {
+            if self.group == 0 {
+                self.buf.extend_from_slice(block);
+            } else {
+                for &digit in block {
+                    if self.left_in_group == 0 {
+                        self.buf.push(b' ');
+                        self.left_in_group = self.group;
+                    }
+                    self.buf.push(digit);
+                    self.left_in_group -= 1;
+                }
+            }
+            if self.buf.len() >= STREAM_BLOCK {
+                self.flush()?;
+            }
+        }
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::testing::XorShift;
+    use crate::{convert_base, group_digits, pad_width};
+
+    #[test]
+    fn format_into_matches_pad_then_group() -> Result<(), ConversionError> {
+        for num in [
+            "0",
+            "7",
+            "255",
+            "65535",
+            "3735928559",
+            &u128::MAX.to_string(),
+        ] {
+            for tgt in [
+                NumSystem::Bin,
+                NumSystem::Oct,
+                NumSystem::Dec,
+                NumSystem::Hex,
+            ] {
+                for (grouping, width) in [(0, 1), (3, 1), (4, 12), (1, 5), (5, 3), (4, 130)] {
+                    let plan = ConversionPlan::new(
+                        NumSystem::Dec,
+                        tgt,
+                        grouping,
+                        width,
+                        Separators::none(),
+                    );
+                    let expected = group_digits(
+                        &pad_width(&convert_base(num, NumSystem::Dec, tgt)?, width),
+                        grouping,
+                    );
+                    assert_eq!(plan.convert(num)?, expected);
+                }
+            }
+        }
+        Ok(())
+    }
+
+    #[test]
+    fn big_conversion_streams_the_same_layout() -> Result<(), ConversionError> {
+        /// Records the size of the largest write.
+        struct Blocks(Vec<u8>, usize);
+        impl Write for Blocks {
+            fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+                self.1 = self.1.max(buf.len());
+                self.0.write(buf)
+            }
+            fn flush(&mut self) -> io::Result<()> {
+                Ok(())
+            }
+        }
+
+        let mut rng = XorShift::new(0x2545_F491);
+        let digits: Vec<u8> = (0..20_000)
+            .map(|_| b'0' + (rng.next_u64() % 10) as u8)
+            .collect();
+        for num in [&b"0"[..], b"3735928559", &digits] {
+            let value = BigUint::parse(num, NumSystem::Dec, Separators::none())?;
+            for tgt in [NumSystem::Bin, NumSystem::Dec, NumSystem::Hex] {
+                let digits = value.to_digits(tgt);
+                for (grouping, width) in [(0, 1), (3, 1), (4, 130), (5, 1_000_000)] {
+                    let plan = ConversionPlan::new(
+                        NumSystem::Dec,
+                        tgt,
+                        grouping,
+                        width,
+                        Separators::none(),
+                    );
+                    let mut expected = Vec::new();
+                    plan.layout(&digits, &mut expected);
+                    let mut out = Blocks(Vec::new(), 0);
+                    plan.convert_big_to(num, &mut out)?;
+                    assert!(out.0 == expected, "{} digits to {:?}", num.len(), tgt);
+                    assert!(out.1 <= 3 * STREAM_BLOCK);
+                }
+            }
+        }
+        Ok(())
+    }
+
+    #[test]
+    fn plan_round_trips_grouped_output() -> Result<(), ConversionError> {
+        let to_hex = ConversionPlan::new(NumSystem::Dec, NumSystem::Hex, 4, 1, Separators::none());
+        let to_dec =
+            ConversionPlan::new(NumSystem::Hex, NumSystem::Dec, 0, 1, Separators::new(b" "));
+        assert_eq!(
+            to_dec.convert(&to_hex.convert("3735928559")?)?,
+            "3735928559"
+        );
+        Ok(())
+    }
+}
@@ -0,0 +1,307 @@
+//! A persistent cache of the decimal power tree.
+//!
+//! Converting a huge number to or from decimal needs the powers `10^(9 * 2^k)` and, for
+//! formatting, their reciprocals. For numbers of millions of digits, building them takes
+//! longer than the conversion itself. With [`set_power_cache`], the tree is stored in a file
+//! that later runs map into memory instead of building it again. Levels that a run needs
+//! beyond those in the file are built as usual and the file is rewritten with them.
+//!
+//! The file holds a header, an index of the levels and their limbs:
+//!
+//! ```text
+//! magic "nconvpow", version: u32, leaf: u32, levels: u32, reserved: u32, checksum: u64
+//! per level: power start, power len, reciprocal start, reciprocal len (u64 each, in limbs)
+//! limbs: u32...
+//! ```
+//!
+//! All fields are little-endian. The checksum covers the header fields from the version to
+//! the reserved word and everything after the header. Level 0 must be the leaf itself and
+//! every higher level as long as the square of the one below, with a reciprocal one limb
+//! longer or as long as its power. A file with another version or leaf, a wrong checksum or
+//! implausible levels is ignored and replaced.
+use crate::input::MappedFile;
+use std::io::{self, Write};
+use std::ops::Range;
+use std::path::{Path, PathBuf};
+use std::sync::{Arc, Mutex};
+
+const MAGIC: &[u8; 8] = b"nconvpow";
+const VERSION: u32 = 2;
+const HEADER_BYTES: usize = 32;
+const FILE_NAME: &str = "decimal.powers";
+
+/// The cache directory and the table loaded from it.
+struct Cache {
+    dir: PathBuf,
+    /// `None` until the file is first needed, then the table if it was valid.
+    table: Option<Option<Arc<PowerTable>>>,
+}
+
+static CACHE: Mutex<Option<Cache>> = Mutex::new(None);
+
+/// A level of the power tree: the range of its power and, if known, of its reciprocal.
+pub(crate) type LevelRanges = (Range<usize>, Option<Range<usize>>);
+
+/// A validated power tree file, mapped into memory.
+pub(crate) struct PowerTable {
+    file: MappedFile,
+    levels: Vec<LevelRanges>,
+}
+
+impl PowerTable {
+    /// Returns the ranges of the limbs of every level, lowest first.
+    pub(crate) fn levels(&self) -> &[LevelRanges] {
+        &self.levels
+    }
+
+    /// Returns the limbs in `range`.
+    pub(crate) fn limbs(&self, range: Range<usize>) -> &[u32] {
+        &words(&self.file[self.data_start()..])[range]
+    }
+
+    fn data_start(&self) -> usize {
+        HEADER_BYTES + self.levels.len() * 32
+    }
+
+    /// Maps and validates the file at `path`.
+    fn open(path: &Path, leaf: u32) -> io::Result<PowerTable> {
+        let file = MappedFile::open(path)?;
+        let invalid = |what: &str| io::Error::new(io::ErrorKind::InvalidData, what.to_string());
+        let field = |at: usize| u32::from_le_bytes(file[at..at + 4].try_into().expect("4 bytes"));
+        if file.len() < HEADER_BYTES || &file[..8] != MAGIC {
+            return Err(invalid("not an nconv power cache"));
+        }
+        if field(8) != VERSION || field(12) != leaf {
+            return Err(invalid("power cache of another version"));
+        }
+        let count = field(16) as usize;
+        let data_start = HEADER_BYTES + count * 32;
+        // The limbs are read in place, which needs them aligned and in native byte order.
+        if cfg!(target_endian = "big")
+            || file.len() < data_start
+            || !(file.len() - data_start).is_multiple_of(4)
+            || !(file.as_ptr() as usize).is_multiple_of(4)
+        {
+            return Err(invalid("unusable power cache"));
+        }
+        let checksum = u64::from_le_bytes(file[24..32].try_into().expect("8 bytes"));
+        let fields = words(&file[8..24]).iter();
+        if checksum != self::checksum(fields.chain(words(&file[HEADER_BYTES..])).copied()) {
+            return Err(invalid("power cache checksum mismatch"));
+        }
+
+        let limbs = (file.len() - data_start) / 4;
+        let mut levels = Vec::with_capacity(count);
+        for entry in file[HEADER_BYTES..data_start].chunks_exact(32) {
+            let word = |i: usize| u64::from_le_bytes(entry[i * 8..i * 8 + 8].try_into().unwrap());
+            let range = |start: u64, len: u64| -> io::Result<Range<usize>> {
+                let end = start.checked_add(len).filter(|&end| end <= limbs as u64);
+                match end {
+                    Some(end) => Ok(start as usize..end as usize),
+                    None => Err(invalid("power cache index out of bounds")),
+                }
+            };
+            let reciprocal = match word(3) {
+                0 => None,
+                len => Some(range(word(2), len)?),
+            };
+            levels.push((range(word(0), word(1))?, reciprocal));
+        }
+
+        let table = PowerTable { file, levels };
+        if !table.is_plausible(leaf) {
+            return Err(invalid("power cache levels are inconsistent"));
+        }
+        Ok(table)
+    }
+
+    /// Checks that the levels have the shape of the power tree of `leaf`.
+    fn is_plausible(&self, leaf: u32) -> bool {
+        let mut below: Option<usize> = None;
+        self.levels.iter().all(|(power, reciprocal)| {
+            let limbs = self.limbs(power.clone());
+            let n = limbs.len();
+            let shape = match below {
+                None => limbs == [leaf],
+                Some(m) => limbs.last() != Some(&0) && (2 * m - 1..=2 * m).contains(&n),
+            };
+            below = Some(n);
+            shape
+                && reciprocal
+                    .as_ref()
+                    .is_none_or(|r| (n..=n + 1).contains(&r.len()))
+        })
+    }
+}
+
+/// Reinterprets bytes as limbs; the length must be a multiple of 4 and the start aligned.
+fn words(bytes: &[u8]) -> &[u32] {
+    // SAFETY: any bit pattern is a valid u32. `PowerTable::open` checked the alignment of
+    // the mapping, and the header and index are a multiple of 4 bytes long.
+    let (head, words, tail) = unsafe { bytes.align_to::<u32>() };
+    assert!(head.is_empty() && tail.is_empty(), "power cache misaligned");
+    words
+}
+
+/// Returns a 64-bit FNV-1a hash of `words`, taken a limb at a time.
+fn checksum(words: impl Iterator<Item = u32>) -> u64 {
+    words.fold(0xCBF2_9CE4_8422_2325, |hash, word| {
+        (hash ^ word as u64).wrapping_mul(0x0000_0100_0000_01B3)
+    })
+}
+
+/// Keeps the decimal power tree in `dir` across runs.
+///
+/// Big-number conversions to and from decimal from now on take the powers and reciprocals
+/// they need from the cache file in `dir`, and add those it lacks to it. A cache that cannot
+/// be read or written is rebuilt or left alone without failing the conversion.
+///
+/// # Arguments
+/// * `dir` - The cache directory, which is created if needed.
+///
+/// # Returns
+/// * `Ok(())` - If the directory exists.
+/// * `Err(io::Error)` - If it could not be created.
+pub fn set_power_cache(dir: &Path) -> io::Result<()> {
+    std::fs::create_dir_all(dir)?;
+    *CACHE.lock().expect("power cache poisoned") = Some(Cache {
+        dir: dir.to_path_buf(),
+        table: None,
+    });
+    Ok(())
+}
+
+/// Returns the cached power tree for `leaf`, mapping it on first use.
+pub(crate) fn cached_powers(leaf: u32) -> Option<Arc<PowerTable>> {
+    let mut cache = CACHE.lock().expect("power cache poisoned");
+    let cache = cache.as_mut()?;
+    cache
+        .table
+        .get_or_insert_with(|| {
+            PowerTable::open(&cache.dir.join(FILE_NAME), leaf)
+                .ok()
+                .map(Arc::new)
+        })
+        .clone()
+}
+
+/// Writes the power tree `levels` of `(power, reciprocal)` to the cache, if one is set, and
+/// maps the new file for later conversions.
+///
+/// The file is replaced atomically, so concurrent runs see either the old or the new tree.
+pub(crate) fn store_powers(leaf: u32, levels: &[(&[u32], Option<&[u32]>)]) {
+    let mut cache = CACHE.lock().expect("power cache poisoned");
+    let Some(cache) = cache.as_mut() else { return };
+    let path = cache.dir.join(FILE_NAME);
+    let tmp = cache
+        .dir
+        .join(format!(".{}.{}.tmp", FILE_NAME, std::process::id()));
+    match write_table(&tmp, leaf, levels).and_then(|()| std::fs::rename(&tmp, &path)) {
+        Ok(()) => cache.table = Some(PowerTable::open(&path, leaf).ok().map(Arc::new)),
+        Err(_) => {
+            let _ = std::fs::remove_file(&tmp);
+        }
+    }
+}
+
+fn write_table(path: &Path, leaf: u32, levels: &[(&[u32], Option<&[u32]>)]) -> io::Result<()> {
+    let mut index = Vec::with_capacity(levels.len() * 8);
+    let mut next = 0u64;
+    let mut entry = |limbs: Option<&[u32]>| {
+        let len = limbs.map_or(0, |limbs| limbs.len() as u64);
+        let start = if len == 0 { 0 } else { next };
+        next += len;
+        for word in [start, len] {
+            index.extend([word as u32, (word >> 32) as u32]);
+        }
+    };
+    for &(power, reciprocal) in levels {
+        entry(Some(power));
+        entry(reciprocal);
+    }
+    let limbs = levels
+        .iter()
+        .flat_map(|&(power, reciprocal)| [Some(power), reciprocal])
+        .flatten()
+        .flatten()
+        .copied();
+    let fields = [VERSION, leaf, levels.len() as u32, 0];
+    let checksum = checksum(
+        fields
+            .into_iter()
+            .chain(index.iter().copied())
+            .chain(limbs.clone()),
+    );
+
+    let mut out = io::BufWriter::new(std::fs::File::create(path)?);
+    out.write_all(MAGIC)?;
+    for field in fields {
+        out.write_all(&field.to_le_bytes())?;
+    }
+    out.write_all(&checksum.to_le_bytes())?;
+    for word in index.into_iter().chain(limbs) {
+        out.write_all(&word.to_le_bytes())?;
+    }
+    out.into_inner().map_err(|e| e.into_error())?.sync_all()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Returns the limbs of `value`, without leading zeros.
+    fn limbs(value: u128) -> Vec<u32> {
+        let len = (128 - value.leading_zeros() as usize).div_ceil(32);
+        (0..len).map(|i| (value >> (32 * i)) as u32).collect()
+    }
+
+    #[test]
+    fn stored_tables_map_back_and_corruption_is_detected() {
+        let path = std::env::temp_dir().join(format!("nconv-powers-{}", std::process::id()));
+        const LEAF: u32 = 1_000_000_000;
+        let powers = [
+            limbs(10u128.pow(9)),
+            limbs(10u128.pow(18)),
+            limbs(10u128.pow(36)),
+        ];
+        // floor(B^4 / 10^18); 10^18 does not divide B^4, so dividing B^4 - 1 gives the same.
+        let reciprocal = limbs(u128::MAX / 10u128.pow(18));
+        let levels = [
+            (&powers[0][..], None),
+            (&powers[1][..], Some(&reciprocal[..])),
+            (&powers[2][..], None),
+        ];
+        write_table(&path, LEAF, &levels).unwrap();
+
+        let table = PowerTable::open(&path, LEAF).unwrap();
+        let ranges = table.levels().to_vec();
+        assert_eq!(ranges.len(), 3);
+        for ((power, reciprocal), (expected, expected_reciprocal)) in ranges.iter().zip(levels) {
+            assert_eq!(table.limbs(power.clone()), expected);
+            let reciprocal = reciprocal.clone().map(|range| table.limbs(range));
+            assert_eq!(reciprocal, expected_reciprocal);
+        }
+        assert!(PowerTable::open(&path, 100).is_err());
+
+        let bytes = std::fs::read(&path).unwrap();
+        // The last limb, and the level count in the header.
+        for (at, flip) in [(bytes.len() - 1, 1), (16, 3 ^ 2)] {
+            let mut corrupt = bytes.clone();
+            corrupt[at] ^= flip;
+            std::fs::write(&path, &corrupt).unwrap();
+            assert!(PowerTable::open(&path, LEAF).is_err(), "byte {}", at);
+        }
+
+        // Checksummed files whose levels are not a power tree.
+        let (wrong, short) = (limbs(7 << 80), limbs(10u128.pow(17)));
+        for levels in [
+            [(&powers[1][..], None), (&powers[2][..], None)],
+            [(&powers[0][..], None), (&wrong[..], None)],
+            [(&powers[0][..], None), (&powers[1][..], Some(&short[..1]))],
+        ] {
+            write_table(&path, LEAF, &levels).unwrap();
+            assert!(PowerTable::open(&path, LEAF).is_err());
+        }
+        std::fs::remove_file(&path).unwrap();
+    }
+}
@@ -0,0 +1,580 @@
+//! Per-machine selection of parse and format kernels.
+//!
+//! Which kernel is fastest, and from which digit count on, depends on the CPU. A [`Profile`]
+//! records the choice for every pair of number systems. [`Profile::tune`] measures it on the
+//! running machine, and the result is stored in a small text file that later runs load on
+//! first use. Without a profile every pair uses [`Kernels::default`], the general kernels.
+use crate::mul::{self, MulThresholds};
+use crate::{kernels, ConversionPlan, NumSystem, Parser, Separators};
+use clap::ValueEnum;
+use std::fmt::Display;
+use std::hint::black_box;
+use std::io;
+use std::path::{Path, PathBuf};
+use std::sync::RwLock;
+use std::time::{Duration, Instant};
+
+const HEADER: &str = "nconv profile 1";
+
+const BASES: [NumSystem; 4] = [
+    NumSystem::Bin,
+    NumSystem::Oct,
+    NumSystem::Dec,
+    NumSystem::Hex,
+];
+
+/// How numbers are parsed.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum ParseKernel {
+    /// The general [`Parser`], which folds a machine word of digits at a time.
+    #[default]
+    Chunked,
+    /// Eight digits per step with SWAR arithmetic, for numbers of at least
+    /// [`Kernels::swar_min_digits`] digits without prefix or separators.
+    Swar,
+}
+
+/// How values are turned into digits.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum FormatKernel {
+    /// Repeated `u128` division by the base.
+    #[default]
+    Wide,
+    /// Shifts for power-of-two bases and `u64` divisions for decimal.
+    Split,
+}
+
+/// The kernels used to convert between one pair of number systems.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Kernels {
+    /// The parse kernel.
+    pub parse: ParseKernel,
+    /// The shortest number parsed with [`ParseKernel::Swar`].
+    pub swar_min_digits: u32,
+    /// The format kernel.
+    pub format: FormatKernel,
+    /// Whether small values are formatted from the [`small_table`](crate::small_table).
+    pub table: bool,
+    /// Whether batches of short numbers are converted several at a time in SIMD lanes.
+    pub lanes: bool,
+}
+
+impl Default for Kernels {
+    fn default() -> Kernels {
+        Kernels {
+            parse: ParseKernel::Chunked,
+            swar_min_digits: 8,
+            format: FormatKernel::Wide,
+            table: true,
+            lanes: false,
+        }
+    }
+}
+
+impl Kernels {
+    /// Parses `num` with the SWAR kernel if it applies.
+    ///
+    /// # Returns
+    /// `None` if the chunked parser has to be used, either by choice or because `num` is not
+    /// a plain run of digits.
+    #[inline]
+    pub(crate) fn parse_fast(&self, num: &[u8], base: NumSystem) -> Option<u128> {
+        if self.parse != ParseKernel::Swar || num.len() < self.swar_min_digits as usize {
+            return None;
+        }
+        // A leading zero and a letter may be a prefix, which the general parser checks.
+        if num[0] == b'0' && num.get(1).is_some_and(u8::is_ascii_alphabetic) {
+            return None;
+        }
+        kernels::parse_swar(num, base)
+    }
+
+    /// Writes the digits of `value` into the end of `buf` with the format kernel.
+    #[inline]
+    pub(crate) fn format<'a>(
+        &self,
+        value: u128,
+        target: NumSystem,
+        buf: &'a mut [u8; 128],
+    ) -> &'a [u8] {
+        match self.format {
+            FormatKernel::Wide => crate::format_digits(value, target, buf),
+            FormatKernel::Split => kernels::format_split(value, target, buf),
+        }
+    }
+}
+
+/// The kernels chosen for every pair of number systems.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct Profile {
+    pairs: [[Kernels; 4]; 4],
+    /// The multiplication crossovers of the big-number path.
+    pub mul: MulThresholds,
+}
+
+fn index(base: NumSystem) -> usize {
+    match base {
+        NumSystem::Bin => 0,
+        NumSystem::Oct => 1,
+        NumSystem::Dec => 2,
+        NumSystem::Hex => 3,
+    }
+}
+
+fn name(base: NumSystem) -> &'static str {
+    match base {
+        NumSystem::Bin => "bin",
+        NumSystem::Oct => "oct",
+        NumSystem::Dec => "dec",
+        NumSystem::Hex => "hex",
+    }
+}
+
+impl Profile {
+    /// Returns the kernels for converting from `src` to `tgt`.
+    pub fn get(&self, src: NumSystem, tgt: NumSystem) -> Kernels {
+        self.pairs[index(src)][index(tgt)]
+    }
+
+    /// Sets the kernels for converting from `src` to `tgt`.
+    pub fn set(&mut self, src: NumSystem, tgt: NumSystem, kernels: Kernels) {
+        self.pairs[index(src)][index(tgt)] = kernels;
+    }
+
+    /// Returns where profiles are stored by default: `$NCONV_PROFILE` if set, otherwise
+    /// `nconv/profile` in `$XDG_CACHE_HOME` or `~/.cache`.
+    pub fn default_path() -> Option<PathBuf> {
+        let var = |name| std::env::var_os(name).filter(|v| !v.is_empty());
+        if let Some(path) = var("NCONV_PROFILE") {
+            return Some(PathBuf::from(path));
+        }
+        let cache = match var("XDG_CACHE_HOME") {
+            Some(dir) => PathBuf::from(dir),
+            None => PathBuf::from(var("HOME")?).join(".cache"),
+        };
+        Some(cache.join("nconv").join("profile"))
+    }
+
+    /// Reads a profile stored by [`Profile::store`]. Pairs it does not mention keep the
+    /// default kernels.
+    pub fn load(path: &Path) -> io::Result<Profile> {
+        let text = std::fs::read_to_string(path)?;
+        let invalid = |line: &str| {
+            io::Error::new(
+                io::ErrorKind::InvalidData,
+                format!("not an nconv profile: {:?}", line),
+            )
+        };
+        let mut lines = text.lines();
+        let header = lines.next().unwrap_or_default();
+        if header != HEADER {
+            return Err(invalid(header));
+        }
+        let mut profile = Profile::default();
+        for line in lines.filter(|line| !line.trim().is_empty()) {
+            let fields: Vec<&str> = line.split_whitespace().collect();
+            if let ["mul", karatsuba, ntt] = fields[..] {
+                let limbs = |s: &str| s.parse().map_err(|_| invalid(line));
+                profile.mul = MulThresholds {
+                    karatsuba: limbs(karatsuba)?,
+                    ntt: limbs(ntt)?,
+                };
+                continue;
+            }
+            // Profiles written before the lane kernels existed have no seventh field.
+            let lanes = match fields.len() {
+                6 => "nolanes",
+                7 => fields[6],
+                _ => return Err(invalid(line)),
+            };
+            let [src, tgt, parse, min, format, table] = fields[..6] else {
+                return Err(invalid(line));
+            };
+            let base = |s| NumSystem::from_str(s, false).map_err(|_| invalid(line));
+            let kernels = Kernels {
+                parse: match parse {
+                    "chunked" => ParseKernel::Chunked,
+                    "swar" => ParseKernel::Swar,
+                    _ => return Err(invalid(line)),
+                },
+                swar_min_digits: min.parse().map_err(|_| invalid(line))?,
+                format: match format {
+                    "wide" => FormatKernel::Wide,
+                    "split" => FormatKernel::Split,
+                    _ => return Err(invalid(line)),
+                },
+                table: match table {
+                    "table" => true,
+                    "notable" => false,
+                    _ => return Err(invalid(line)),
+                },
+                lanes: match lanes {
+                    "lanes" => true,
+                    "nolanes" => false,
+                    _ => return Err(invalid(line)),
+                },
+            };
+            profile.set(base(src)?, base(tgt)?, kernels);
+        }
+        Ok(profile)
+    }
+
+    /// Stores the profile at `path`, creating its directory and atomically replacing any
+    /// previous profile.
+    pub fn store(&self, path: &Path) -> io::Result<()> {
+        if let Some(dir) = path.parent().filter(|dir| !dir.as_os_str().is_empty()) {
+            std::fs::create_dir_all(dir)?;
+        }
+        let mut tmp = path.as_os_str().to_owned();
+        tmp.push(".tmp");
+        std::fs::write(&tmp, self.to_string())?;
+        std::fs::rename(&tmp, path)
+    }
+
+    /// Measures the kernels on this machine and returns the fastest choice for every pair.
+    ///
+    /// Parse kernels are timed per source base and digit count, format kernels per target
+    /// base over values of every bit width. Each pair's combined choice is then checked
+    /// against the default kernels on a mixed workload and only kept if it is faster, and
+    /// the lane kernels are kept if they speed up a workload of `u64` values. The
+    /// calibration takes well under a second.
+    pub fn tune() -> Profile {
+        let mut profile = Profile {
+            mul: tune_mul(),
+            ..Profile::default()
+        };
+        let formats = BASES.map(tune_format);
+        for src in BASES {
+            let parse = tune_parse(src);
+            for tgt in BASES {
+                let format = formats[index(tgt)];
+                let tuned = Kernels {
+                    parse: parse.0,
+                    swar_min_digits: parse.1,
+                    format: format.0,
+                    table: format.1,
+                    lanes: false,
+                };
+                let workload = Workload::mixed(src);
+                let default = workload.time(src, tgt, Kernels::default());
+                let mut chosen = match workload.time(src, tgt, tuned) < default {
+                    true => tuned,
+                    false => Kernels::default(),
+                };
+                // Lanes pay off on long runs of short numbers, such as u64 IDs.
+                let workload = Workload::word_sized(src);
+                let lanes = Kernels {
+                    lanes: true,
+                    ..chosen
+                };
+                if workload.time(src, tgt, lanes) < workload.time(src, tgt, chosen) {
+                    chosen = lanes;
+                }
+                profile.set(src, tgt, chosen);
+            }
+        }
+        profile
+    }
+}
+
+impl Display for Profile {
+    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+        writeln!(f, "{}", HEADER)?;
+        writeln!(f, "mul {} {}", self.mul.karatsuba, self.mul.ntt)?;
+        for src in BASES {
+            for tgt in BASES {
+                let kernels = self.get(src, tgt);
+                writeln!(
+                    f,
+                    "{} {} {} {} {} {} {}",
+                    name(src),
+                    name(tgt),
+                    match kernels.parse {
+                        ParseKernel::Chunked => "chunked",
+                        ParseKernel::Swar => "swar",
+                    },
+                    kernels.swar_min_digits,
+                    match kernels.format {
+                        FormatKernel::Wide => "wide",
+                        FormatKernel::Split => "split",
+                    },
+                    if kernels.table { "table" } else { "notable" },
+                    if kernels.lanes { "lanes" } else { "nolanes" },
+                )?;
+            }
+        }
+        Ok(())
+    }
+}
+
+/// The profile used by new [`ConversionPlan`]s, loaded from [`Profile::default_path`] on
+/// first use.
+static CURRENT: RwLock<Option<Profile>> = RwLock::new(None);
+
+/// Sets the profile used by conversion plans created from now on.
+pub fn set_profile(profile: Profile) {
+    *CURRENT.write().expect("profile poisoned") = Some(profile);
+}
+
+/// Returns the profile used by new conversion plans.
+///
+/// On first use the profile is loaded from [`Profile::default_path`]. A missing or
+/// unreadable profile silently falls back to the default kernels.
+pub fn current_profile() -> Profile {
+    if let Some(profile) = *CURRENT.read().expect("profile poisoned") {
+        return profile;
+    }
+    let mut current = CURRENT.write().expect("profile poisoned");
+    *current.get_or_insert_with(|| {
+        Profile::default_path()
+            .and_then(|path| Profile::load(&path).ok())
+            .unwrap_or_default()
+    })
+}
+
+/// Returns the fastest of three runs of `f`.
+fn fastest(mut f: impl FnMut()) -> Duration {
+    (0..3)
+        .map(|_| {
+            let start = Instant::now();
+            f();
+            start.elapsed()
+        })
+        .min()
+        .expect("three runs")
+}
+
+/// Pseudo-random values with every bit width from 1 to 128 equally often.
+fn sample_values(count: usize) -> Vec<u128> {
+    let mut x = 0x2545_F491_4F6C_DD1Du128;
+    (0..count)
+        .map(|i| {
+            x = x.wrapping_mul(0x5851_F42D_4C95_7F2D_1405_7B7E_F767_814F) + 1;
+            let bits = i % 128 + 1;
+            (x >> (128 - bits)) | 1 << (bits - 1)
+        })
+        .collect()
+}
+
+fn digits_of(value: u128, base: NumSystem) -> Vec<u8> {
+    let mut buf = [0u8; 128];
+    crate::format_digits(value, base, &mut buf).to_vec()
+}
+
+/// Finds the parse kernel for `src` and the digit count from which SWAR is used.
+///
+/// Both kernels are timed at every length SWAR supports; the threshold is the one that
+/// minimizes the total time over all lengths.
+fn tune_parse(src: NumSystem) -> (ParseKernel, u32) {
+    let max = kernels::max_safe_digits(src);
+    let radix = src as u32 as u128;
+    let mut chunked = vec![Duration::ZERO; max + 1];
+    let mut swar = vec![Duration::ZERO; max + 1];
+    for len in 1..=max {
+        let tokens: Vec<Vec<u8>> = sample_values(256)
+            .into_iter()
+            .map(|v| {
+                let v = v % radix.pow(len as u32 - 1).saturating_mul(radix - 1)
+                    + radix.pow(len as u32 - 1);
+                digits_of(v, src)
+            })
+            .collect();
+        chunked[len] = fastest(|| {
+            for token in &tokens {
+                let mut parser = Parser::with_separators(src, Separators::none());
+                let _ = black_box(parser.feed(black_box(token)));
+                let _ = black_box(parser.finish());
+            }
+        });
+        swar[len] = fastest(|| {
+            for token in &tokens {
+                black_box(kernels::parse_swar(black_box(token), src));
+            }
+        });
+    }
+
+    let mut best = (Duration::MAX, max + 1);
+    for threshold in 1..=max + 1 {
+        let total = chunked[1..threshold].iter().sum::<Duration>()
+            + swar[threshold..].iter().sum::<Duration>();
+        if total < best.0 {
+            best = (total, threshold);
+        }
+    }
+    match best.1 {
+        t if t > max => (ParseKernel::Chunked, Kernels::default().swar_min_digits),
+        t => (ParseKernel::Swar, t as u32),
+    }
+}
+
+/// Finds the format kernel for `tgt` and whether the small-value table pays off.
+fn tune_format(tgt: NumSystem) -> (FormatKernel, bool) {
+    let mut values = sample_values(4096);
+    // Small values are common in practice; give the table something to win on.
+    values.iter_mut().step_by(4).for_each(|v| *v &= 0xFFFF);
+    let table = crate::small_table(tgt);
+    let mut best = (Duration::MAX, FormatKernel::Wide, true);
+    for format in [FormatKernel::Wide, FormatKernel::Split] {
+        for use_table in [true, false] {
+            let kernels = Kernels {
+                format,
+                table: use_table,
+                ..Kernels::default()
+            };
+            let time = fastest(|| {
+                let mut buf = [0u8; 128];
+                for &value in &values {
+                    let value = black_box(value);
+                    match table.get(value).filter(|_| use_table) {
+                        Some(digits) => black_box(digits.as_bytes()),
+                        None => black_box(kernels.format(value, tgt, &mut buf)),
+                    };
+                }
+            });
+            if time < best.0 {
+                best = (time, format, use_table);
+            }
+        }
+    }
+    (best.1, best.2)
+}
+
+/// Finds the factor lengths from which Karatsuba and the NTT beat the next simpler algorithm.
+fn tune_mul() -> MulThresholds {
+    let limbs = |n: usize| -> Vec<u32> { sample_values(n).iter().map(|&v| v as u32).collect() };
+    let mut thresholds = MulThresholds {
+        karatsuba: 256,
+        ntt: usize::MAX,
+    };
+    for n in [8, 12, 16, 24, 32, 48, 64, 96, 128, 192] {
+        let (a, b) = (limbs(n), limbs(n));
+        let schoolbook = fastest(|| drop(black_box(mul::schoolbook(&a, &b))));
+        // One Karatsuba level over schoolbook halves.
+        let split = MulThresholds {
+            karatsuba: n,
+            ntt: usize::MAX,
+        };
+        if fastest(|| drop(black_box(mul::mul(&a, &b, split)))) < schoolbook {
+            thresholds.karatsuba = n;
+            break;
+        }
+    }
+    for n in [256, 512, 1024, 2048, 4096, 8192] {
+        let (a, b) = (limbs(n), limbs(n));
+        let karatsuba = fastest(|| drop(black_box(mul::mul(&a, &b, thresholds))));
+        if fastest(|| drop(black_box(crate::ntt::mul(&a, &b)))) < karatsuba {
+            thresholds.ntt = n;
+            break;
+        }
+    }
+    if thresholds.ntt == usize::MAX {
+        thresholds.ntt = 16384;
+    }
+    thresholds
+}
+
+/// Tokens of every length in one base, converted end to end to compare whole kernel sets.
+struct Workload {
+    tokens: Vec<Vec<u8>>,
+}
+
+impl Workload {
+    fn mixed(src: NumSystem) -> Workload {
+        Workload {
+            tokens: sample_values(2048)
+                .into_iter()
+                .map(|v| digits_of(v, src))
+                .collect(),
+        }
+    }
+
+    fn word_sized(src: NumSystem) -> Workload {
+        Workload {
+            tokens: sample_values(2048)
+                .into_iter()
+                .map(|v| digits_of(v as u64 as u128, src))
+                .collect(),
+        }
+    }
+
+    fn time(&self, src: NumSystem, tgt: NumSystem, kernels: Kernels) -> Duration {
+        let mut plan = ConversionPlan::new(src, tgt, 0, 1, Separators::none());
+        plan.kernels = kernels;
+        let tokens: Vec<&[u8]> = self.tokens.iter().map(Vec::as_slice).collect();
+        let mut out = Vec::with_capacity(self.tokens.len() * 130);
+        fastest(|| {
+            out.clear();
+            plan.convert_tokens(black_box(&tokens), &mut out, &mut |_, _| ());
+            black_box(&out);
+        })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn profiles_round_trip_and_reject_other_files() -> io::Result<()> {
+        let path = std::env::temp_dir()
+            .join(format!("nconv-profile-{}", std::process::id()))
+            .join("profile");
+        let mut profile = Profile::default();
+        profile.mul.ntt = 3000;
+        profile.set(
+            NumSystem::Hex,
+            NumSystem::Dec,
+            Kernels {
+                parse: ParseKernel::Swar,
+                swar_min_digits: 12,
+                format: FormatKernel::Split,
+                table: false,
+                lanes: true,
+            },
+        );
+        profile.store(&path)?;
+        assert_eq!(Profile::load(&path)?, profile);
+
+        std::fs::write(&path, format!("{}\nhex dec simd 8 wide table\n", HEADER))?;
+        assert_eq!(
+            Profile::load(&path).unwrap_err().kind(),
+            io::ErrorKind::InvalidData
+        );
+        std::fs::remove_dir_all(path.parent().unwrap())
+    }
+
+    #[test]
+    fn every_kernel_choice_converts_identically() {
+        let values = sample_values(512);
+        for src in BASES {
+            for tgt in BASES {
+                let mut plans = Vec::new();
+                for parse in [ParseKernel::Chunked, ParseKernel::Swar] {
+                    for format in [FormatKernel::Wide, FormatKernel::Split] {
+                        let mut plan = ConversionPlan::new(src, tgt, 3, 5, Separators::none());
+                        plan.kernels = Kernels {
+                            parse,
+                            swar_min_digits: 1,
+                            format,
+                            table: format == FormatKernel::Wide,
+                            lanes: false,
+                        };
+                        plans.push(plan);
+                    }
+                }
+                for value in &values {
+                    let token = digits_of(*value, src);
+                    let outputs: Vec<_> = plans
+                        .iter()
+                        .map(|plan| {
+                            let mut out = Vec::new();
+                            plan.format_into(plan.parse_bytes(&token).unwrap(), &mut out);
+                            out
+                        })
+                        .collect();
+                    assert!(outputs.windows(2).all(|w| w[0] == w[1]), "{:?}", token);
+                }
+            }
+        }
+    }
+}
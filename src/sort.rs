@@ -0,0 +1,338 @@
+//! Numeric sorting of number files.
+//!
+//! [`sort_numbers`] parses every whitespace-separated token with the rules of
+//! [`convert_base`](crate::convert_base), sorts the values with a least-significant-digit
+//! radix sort and writes them in the target base. Unlike sorting the text, this orders
+//! `0x0F`, `F` and `0x10` by value whatever their prefixes and widths. Parsing, sorting and
+//! formatting are split across threads for large inputs.
+use crate::input::{map_parts, tokens};
+use crate::{ConversionPlan, TokenError};
+use std::io::{self, Write};
+
+/// Fewer values than this are sorted on the calling thread.
+const PARALLEL_MIN_VALUES: usize = 1 << 16;
+
+/// The number of values each thread formats at a time.
+const FORMAT_BATCH: usize = 1 << 16;
+
+/// The number of bits sorted per radix pass.
+const RADIX_BITS: u32 = 8;
+const BUCKETS: usize = 1 << RADIX_BITS;
+
+/// The most radix passes worth running on a single thread; a comparison sort of keys that
+/// need more passes is faster there, while the radix passes still scale across threads.
+const SERIAL_MAX_PASSES: usize = 4;
+
+/// Configuration for a sort run.
+pub struct SortConfig {
+    /// How to parse the input and format the sorted numbers.
+    pub plan: ConversionPlan,
+    /// Whether to write each distinct value only once.
+    pub unique: bool,
+    /// The number of worker threads (0 to use all available cores).
+    pub threads: usize,
+}
+
+impl SortConfig {
+    pub fn new(plan: ConversionPlan, unique: bool, threads: usize) -> SortConfig {
+        SortConfig {
+            plan,
+            unique,
+            threads,
+        }
+    }
+}
+
+/// The result of a sort run.
+#[derive(Debug, Default, PartialEq)]
+pub struct SortReport {
+    /// The number of values written.
+    pub written: usize,
+    /// The number of repeated values left out with `unique`.
+    pub duplicates: usize,
+    /// The number of tokens that failed to parse.
+    pub invalid: usize,
+}
+
+/// An integer that [`radix_sort`] can sort.
+trait RadixKey: Copy + Ord + Send + Sync + Default {
+    /// The number of radix digits.
+    const PASSES: usize;
+
+    /// Returns the radix digit of `self` for `pass`, least significant first.
+    fn digit(self, pass: usize) -> usize;
+
+    /// Returns the bits in which some of `values` differ.
+    fn varying(values: &[Self]) -> Self;
+}
+
+impl RadixKey for u64 {
+    const PASSES: usize = (u64::BITS / RADIX_BITS) as usize;
+
+    #[inline(always)]
+    fn digit(self, pass: usize) -> usize {
+        (self >> (pass as u32 * RADIX_BITS)) as usize & (BUCKETS - 1)
+    }
+
+    fn varying(values: &[u64]) -> u64 {
+        let (and, or) = values
+            .iter()
+            .fold((u64::MAX, 0), |(and, or), &v| (and & v, or | v));
+        and ^ or
+    }
+}
+
+impl RadixKey for u128 {
+    const PASSES: usize = (u128::BITS / RADIX_BITS) as usize;
+
+    #[inline(always)]
+    fn digit(self, pass: usize) -> usize {
+        let half = match pass < u64::PASSES {
+            true => self as u64,
+            false => (self >> 64) as u64,
+        };
+        half.digit(pass % u64::PASSES)
+    }
+
+    fn varying(values: &[u128]) -> u128 {
+        let (and, or) = values
+            .iter()
+            .fold((u128::MAX, 0), |(and, or), &v| (and & v, or | v));
+        and ^ or
+    }
+}
+
+/// A destination that several threads scatter keys into at disjoint positions.
+struct Scatter<K>(*mut K);
+
+// SAFETY: the threads of a radix pass write to disjoint index ranges of the buffer.
+unsafe impl<K: Send> Sync for Scatter<K> {}
+
+/// Counts the radix digits of `keys` for one pass.
+fn histogram<K: RadixKey>(keys: &[K], pass: usize) -> [usize; BUCKETS] {
+    let mut counts = [0; BUCKETS];
+    keys.iter().for_each(|&k| counts[k.digit(pass)] += 1);
+    counts
+}
+
+/// Sorts `values` in ascending order with a least-significant-digit radix sort.
+///
+/// Values that all fit a `u64` are sorted as `u64`s, which halves the memory traffic. Passes
+/// over digits that every value shares are skipped, so small values only take as many passes
+/// as they have significant bytes. With more than one thread, every pass is split into
+/// contiguous parts whose histograms and scatters run in parallel; a single thread sorts keys
+/// wider than [`SERIAL_MAX_PASSES`] digits with `sort_unstable` instead.
+pub(crate) fn radix_sort(values: &mut [u128], threads: usize) {
+    if values.len() < BUCKETS {
+        values.sort_unstable();
+        return;
+    }
+    let threads = match values.len() {
+        n if n < PARALLEL_MIN_VALUES => 1,
+        _ => threads.max(1),
+    };
+    if values.iter().all(|&v| v <= u64::MAX as u128) {
+        let mut keys: Vec<u64> = values.iter().map(|&v| v as u64).collect();
+        sort_keys(&mut keys, threads);
+        values
+            .iter_mut()
+            .zip(keys)
+            .for_each(|(v, k)| *v = k as u128);
+    } else {
+        sort_keys(values, threads);
+    }
+}
+
+fn sort_keys<K: RadixKey>(keys: &mut [K], threads: usize) {
+    // A digit with a single value across all keys leaves the order unchanged.
+    let varying = K::varying(keys);
+    let passes: Vec<usize> = (0..K::PASSES)
+        .filter(|&pass| varying.digit(pass) != 0)
+        .collect();
+    if threads == 1 && passes.len() > SERIAL_MAX_PASSES {
+        keys.sort_unstable();
+        return;
+    }
+    let part = keys.len().div_ceil(threads);
+    let mut buffer = vec![K::default(); keys.len()];
+    let (mut src, mut dst) = (&mut *keys, buffer.as_mut_slice());
+    for &pass in &passes {
+        let counts: Vec<[usize; BUCKETS]> = match threads {
+            1 => vec![histogram(src, pass)],
+            _ => std::thread::scope(|s| {
+                let handles: Vec<_> = src
+                    .chunks(part)
+                    .map(|chunk| s.spawn(move || histogram(chunk, pass)))
+                    .collect();
+                handles
+                    .into_iter()
+                    .map(|h| h.join().expect("sort worker panicked"))
+                    .collect()
+            }),
+        };
+        // Each part writes its keys of a bucket after those of the earlier parts.
+        let mut offsets = vec![[0usize; BUCKETS]; counts.len()];
+        let mut next = 0;
+        for bucket in 0..BUCKETS {
+            for (offset, count) in offsets.iter_mut().zip(&counts) {
+                offset[bucket] = next;
+                next += count[bucket];
+            }
+        }
+
+        let out = Scatter(dst.as_mut_ptr());
+        let scatter = |chunk: &[K], mut offset: [usize; BUCKETS]| {
+            let out = &out;
+            for &k in chunk {
+                let bucket = &mut offset[k.digit(pass)];
+                // SAFETY: the offsets of all parts and buckets partition `0..keys.len()`,
+                // so every index is in bounds and written by exactly one thread.
+                unsafe { out.0.add(*bucket).write(k) };
+                *bucket += 1;
+            }
+        };
+        match threads {
+            1 => scatter(src, offsets[0]),
+            _ => std::thread::scope(|s| {
+                for (chunk, &offset) in src.chunks(part).zip(&offsets) {
+                    s.spawn(move || scatter(chunk, offset));
+                }
+            }),
+        }
+        std::mem::swap(&mut src, &mut dst);
+    }
+    if passes.len() % 2 == 1 {
+        keys.copy_from_slice(&buffer);
+    }
+}
+
+/// Parses the tokens of `data`, which starts at input offset `base_offset`.
+fn parse_range(
+    data: &[u8],
+    base_offset: usize,
+    plan: &ConversionPlan,
+) -> (Vec<u128>, Vec<TokenError>) {
+    let mut values = Vec::with_capacity(data.len() / 8);
+    let mut errors = Vec::new();
+    for (offset, token) in tokens(data) {
+        match plan.parse_bytes(token) {
+            Ok(value) => values.push(value),
+            Err(error) => errors.push(TokenError {
+                offset: base_offset + offset,
+                error,
+            }),
+        }
+    }
+    (values, errors)
+}
+
+/// Formats `values` one per line.
+fn format_values(values: &[u128], plan: &ConversionPlan) -> Vec<u8> {
+    let mut out = Vec::with_capacity(values.len() * 8);
+    for &value in values {
+        plan.format_into(value, &mut out);
+        out.push(b'\n');
+    }
+    out
+}
+
+/// Sorts the whitespace-separated numbers of `data` by value and writes them, one per line.
+///
+/// # Arguments
+/// * `data` - The input, typically a memory-mapped file.
+/// * `config` - The number systems and layout, whether to drop duplicates, and the degree of
+///   parallelism.
+/// * `out` - Receives the sorted numbers.
+/// * `on_error` - Called for every token that failed to parse, in input order. Such tokens are
+///   left out of the output.
+///
+/// # Returns
+/// * `Ok(SortReport)` - The numbers of values written, duplicates dropped and invalid tokens.
+/// * `Err(io::Error)` - If the output could not be written.
+///
+/// # Examples
+///
+/// ```
+/// use nconv::{sort_numbers, ConversionPlan, NumSystem, Separators, SortConfig};
+///
+/// let plan = ConversionPlan::new(NumSystem::Hex, NumSystem::Dec, 0, 1, Separators::none());
+/// let mut out = Vec::new();
+/// let config = SortConfig::new(plan, true, 1);
+/// let report = sort_numbers(b"0x10 F 0x0F 2 0xZ", &config, &mut out, &mut |_| ()).unwrap();
+/// assert_eq!(out, b"2\n15\n16\n");
+/// assert_eq!((report.written, report.duplicates, report.invalid), (3, 1, 1));
+/// ```
+pub fn sort_numbers(
+    data: &[u8],
+    config: &SortConfig,
+    out: &mut dyn Write,
+    on_error: &mut dyn FnMut(TokenError),
+) -> io::Result<SortReport> {
+    let threads = crate::worker_threads(config.threads);
+    let plan = &config.plan;
+    let parts = map_parts(data, threads, |part, offset| {
+        parse_range(part, offset, plan)
+    });
+
+    let mut report = SortReport::default();
+    let mut values = Vec::with_capacity(parts.iter().map(|(v, _)| v.len()).sum());
+    for (part, errors) in parts {
+        values.extend_from_slice(&part);
+        report.invalid += errors.len();
+        errors.into_iter().for_each(&mut *on_error);
+    }
+    radix_sort(&mut values, threads);
+    if config.unique {
+        let len = values.len();
+        values.dedup();
+        report.duplicates = len - values.len();
+    }
+
+    for round in values.chunks(FORMAT_BATCH * threads) {
+        let buffers: Vec<Vec<u8>> = match round.len() {
+            n if n <= FORMAT_BATCH => vec![format_values(round, plan)],
+            _ => std::thread::scope(|s| {
+                let handles: Vec<_> = round
+                    .chunks(FORMAT_BATCH)
+                    .map(|chunk| s.spawn(move || format_values(chunk, plan)))
+                    .collect();
+                handles
+                    .into_iter()
+                    .map(|h| h.join().expect("sort worker panicked"))
+                    .collect()
+            }),
+        };
+        for buffer in buffers {
+            out.write_all(&buffer)?;
+        }
+    }
+    report.written = values.len();
+    Ok(report)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::testing::XorShift;
+
+    #[test]
+    fn radix_sort_matches_std_sort() {
+        let mut rng = XorShift::new(0x9E37_79B9_7F4A_7C15);
+        for (len, shift) in [
+            (10, 0),
+            (1000, 100),
+            (100_000, 64),
+            (100_000, 0),
+            (70_000, 120),
+        ] {
+            let values: Vec<u128> = (0..len).map(|_| rng.next_u128() >> shift).collect();
+            for threads in [1, 3] {
+                let mut sorted = values.clone();
+                radix_sort(&mut sorted, threads);
+                let mut expected = values.clone();
+                expected.sort_unstable();
+                assert!(sorted == expected, "{} values >> {}", len, shift);
+            }
+        }
+    }
+}
@@ -0,0 +1,61 @@
+//! Runtime statistics reported by the command-line tool.
+use crate::BatchReport;
+use std::fmt::Display;
+use std::time::Duration;
+
+/// A snapshot of runtime statistics.
+#[derive(Debug, Default, Clone)]
+pub struct Stats {
+    /// Heap memory held by the shared small-value tables, in bytes.
+    pub table_bytes: usize,
+    /// The result of a batch file conversion, if one ran.
+    pub batch: Option<BatchReport>,
+    /// The wall-clock time of the batch file conversion.
+    pub elapsed: Duration,
+}
+
+impl Stats {
+    /// Collects the current values of all process-wide statistics.
+    pub fn collect() -> Stats {
+        Stats {
+            table_bytes: crate::small_table_memory(),
+            ..Stats::default()
+        }
+    }
+
+    /// Adds the result of a batch file conversion that took `elapsed`.
+    pub fn with_batch(self, report: BatchReport, elapsed: Duration) -> Stats {
+        Stats {
+            batch: Some(report),
+            elapsed,
+            ..self
+        }
+    }
+}
+
+impl Display for Stats {
+    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+        write!(f, "table memory: {} bytes", self.table_bytes)?;
+        if let Some(batch) = &self.batch {
+            let secs = self.elapsed.as_secs_f64();
+            let rate = match secs {
+                0.0 => 0.0,
+                _ => batch.bytes_in as f64 / secs / 1e6,
+            };
+            if let Some(backend) = batch.backend {
+                write!(f, "\nio backend: {}", backend)?;
+            }
+            if batch.files != 1 || batch.files_failed > 0 {
+                write!(f, "\nfiles converted: {}", batch.files)?;
+                write!(f, "\nfiles failed: {}", batch.files_failed)?;
+            }
+            write!(f, "\nnumbers converted: {}", batch.converted)?;
+            write!(f, "\nnumbers failed: {}", batch.failed)?;
+            write!(f, "\nbytes read: {}", batch.bytes_in)?;
+            write!(f, "\nbytes written: {}", batch.bytes_out)?;
+            write!(f, "\npeak buffer memory: {} bytes", batch.peak_memory)?;
+            write!(f, "\nelapsed: {:.3} s ({:.1} MB/s)", secs, rate)?;
+        }
+        Ok(())
+    }
+}
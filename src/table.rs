@@ -0,0 +1,175 @@
+//! Precomputed digit tables for small values.
+//!
+//! Many inputs are small (ports, flags, byte values, 16-bit IDs), and for those the general
+//! division loop in [`format_value`](crate::format_value) is pure overhead. A [`SmallTable`]
+//! holds the preformatted digits of every value below a fixed bound so that formatting such a
+//! value becomes a single indexed copy.
+//!
+//! The shared tables returned by [`small_table`] are built lazily, one per [`NumSystem`], the
+//! first time a value in that base is formatted.
+use crate::NumSystem;
+use std::sync::atomic::{AtomicU32, Ordering};
+use std::sync::OnceLock;
+
+/// The largest supported table bound, in bits. Keeps the four shared tables under 2.5 MiB.
+pub const MAX_SMALL_TABLE_BITS: u32 = 16;
+
+/// The default table bound, in bits.
+pub const DEFAULT_SMALL_TABLE_BITS: u32 = 16;
+
+static SMALL_TABLE_BITS: AtomicU32 = AtomicU32::new(DEFAULT_SMALL_TABLE_BITS);
+static SMALL_TABLES: [OnceLock<SmallTable>; 4] = [
+    OnceLock::new(),
+    OnceLock::new(),
+    OnceLock::new(),
+    OnceLock::new(),
+];
+
+/// Preformatted digits for every value below `2^bits` in a single number system.
+pub struct SmallTable {
+    /// Digits of all entries, each entry left-aligned in a slot of `stride` bytes.
+    digits: String,
+    /// The number of significant digits of each entry.
+    lens: Box<[u8]>,
+    /// The slot size, i.e. the digit count of the largest entry.
+    stride: usize,
+}
+
+impl SmallTable {
+    /// Builds the table for all values below `2^bits` in the `base` number system.
+    ///
+    /// # Arguments
+    /// * `base` - The number system the digits are written in.
+    /// * `bits` - The table bound in bits, clamped to [`MAX_SMALL_TABLE_BITS`].
+    ///
+    /// # Returns
+    /// A table with `2^bits` entries, or an empty table when `bits` is 0.
+    pub fn new(base: NumSystem, bits: u32) -> SmallTable {
+        let bits = bits.min(MAX_SMALL_TABLE_BITS);
+        if bits == 0 {
+            return SmallTable {
+                digits: String::new(),
+                lens: Box::new([]),
+                stride: 0,
+            };
+        }
+
+        let bound = 1usize << bits;
+        let stride = crate::format_value_uncached(bound as u128 - 1, base).len();
+        let mut digits = String::with_capacity(bound * stride);
+        let mut lens = Vec::with_capacity(bound);
+        for value in 0..bound {
+            let entry = crate::format_value_uncached(value as u128, base);
+            lens.push(entry.len() as u8);
+            digits.push_str(&entry);
+            digits.extend(std::iter::repeat_n('0', stride - entry.len()));
+        }
+
+        SmallTable {
+            digits,
+            lens: lens.into_boxed_slice(),
+            stride,
+        }
+    }
+
+    /// Returns the exclusive upper bound of the values held by the table.
+    pub fn bound(&self) -> u128 {
+        self.lens.len() as u128
+    }
+
+    /// Looks up the preformatted digits of `value`.
+    ///
+    /// # Returns
+    /// The digits of `value`, or `None` if `value` is not below the table bound.
+    pub fn get(&self, value: u128) -> Option<&str> {
+        if value >= self.bound() {
+            return None;
+        }
+        let index = value as usize;
+        let start = index * self.stride;
+        Some(&self.digits[start..start + self.lens[index] as usize])
+    }
+
+    /// Returns the heap memory held by the table in bytes.
+    pub fn memory(&self) -> usize {
+        self.digits.capacity() + self.lens.len()
+    }
+}
+
+fn table_index(base: NumSystem) -> usize {
+    match base {
+        NumSystem::Bin => 0,
+        NumSystem::Oct => 1,
+        NumSystem::Dec => 2,
+        NumSystem::Hex => 3,
+    }
+}
+
+/// Sets the bound used for the shared small-value tables.
+///
+/// Only tables that have not been built yet are affected, so this should be called before the
+/// first conversion. A value of 0 disables the tables.
+///
+/// # Arguments
+/// * `bits` - The table bound in bits, clamped to [`MAX_SMALL_TABLE_BITS`].
+pub fn set_small_table_bits(bits: u32) {
+    SMALL_TABLE_BITS.store(bits.min(MAX_SMALL_TABLE_BITS), Ordering::Relaxed);
+}
+
+/// Returns the shared small-value table for `base`, building it on first use.
+pub fn small_table(base: NumSystem) -> &'static SmallTable {
+    SMALL_TABLES[table_index(base)]
+        .get_or_init(|| SmallTable::new(base, SMALL_TABLE_BITS.load(Ordering::Relaxed)))
+}
+
+/// Returns the heap memory held by all shared small-value tables built so far, in bytes.
+pub fn small_table_memory() -> usize {
+    SMALL_TABLES
+        .iter()
+        .filter_map(OnceLock::get)
+        .map(SmallTable::memory)
+        .sum()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn small_table_matches_general_formatter() {
+        for base in [
+            NumSystem::Bin,
+            NumSystem::Oct,
+            NumSystem::Dec,
+            NumSystem::Hex,
+        ] {
+            let table = SmallTable::new(base, 10);
+            assert_eq!(table.bound(), 1024);
+            for value in 0..1024u128 {
+                assert_eq!(
+                    table.get(value),
+                    Some(crate::format_value_uncached(value, base).as_str())
+                );
+            }
+        }
+    }
+
+    #[test]
+    fn small_table_rejects_values_at_or_above_bound() {
+        let table = SmallTable::new(NumSystem::Hex, 8);
+        assert_eq!(table.get(255), Some("FF"));
+        assert_eq!(table.get(256), None);
+        assert_eq!(table.get(u128::MAX), None);
+    }
+
+    #[test]
+    fn small_table_clamps_bound_and_can_be_disabled() {
+        assert_eq!(
+            SmallTable::new(NumSystem::Hex, 64).bound(),
+            1 << MAX_SMALL_TABLE_BITS
+        );
+        let empty = SmallTable::new(NumSystem::Dec, 0);
+        assert_eq!(empty.get(0), None);
+        assert_eq!(empty.memory(), 0);
+    }
+}
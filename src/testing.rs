@@ -0,0 +1,28 @@
+//! Deterministic pseudo-random inputs for tests.
+
+/// A xorshift64 generator; the same seed always gives the same sequence.
+pub(crate) struct XorShift(u64);
+
+impl XorShift {
+    /// Creates a generator from a non-zero seed.
+    pub(crate) fn new(seed: u64) -> XorShift {
+        assert_ne!(seed, 0, "xorshift needs a non-zero seed");
+        XorShift(seed)
+    }
+
+    pub(crate) fn next_u64(&mut self) -> u64 {
+        self.0 ^= self.0 << 13;
+        self.0 ^= self.0 >> 7;
+        self.0 ^= self.0 << 17;
+        self.0
+    }
+
+    pub(crate) fn next_u128(&mut self) -> u128 {
+        ((self.next_u64() as u128) << 64) | self.next_u64() as u128
+    }
+
+    /// Returns `n` random limbs.
+    pub(crate) fn limbs(&mut self, n: usize) -> Vec<u32> {
+        (0..n).map(|_| (self.next_u64() >> 32) as u32).collect()
+    }
+}
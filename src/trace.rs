@@ -0,0 +1,217 @@
+//! Timelines of batch conversions in the Chrome trace-event format.
+//!
+//! While tracing is enabled, the reader, worker and writer threads record a span for every
+//! stage they run on a chunk. Each thread appends to its own buffer, which is handed over
+//! when the thread exits, so recording takes no locks. [`write_trace`] collects the buffers
+//! into a JSON file that Perfetto or `chrome://tracing` can open.
+use std::cell::RefCell;
+use std::io::{self, BufWriter, Write};
+use std::path::Path;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::{Mutex, OnceLock};
+use std::time::{Duration, Instant};
+
+/// A completed span.
+struct Event {
+    name: &'static str,
+    /// The start and duration in nanoseconds since [`EPOCH`].
+    start: u64,
+    duration: u64,
+    chunk: Option<u64>,
+    bytes: Option<u64>,
+}
+
+/// The events of one thread.
+struct Events {
+    tid: u64,
+    name: &'static str,
+    events: Vec<Event>,
+}
+
+impl Events {
+    /// Takes the events recorded so far.
+    fn take(&mut self) -> Events {
+        Events {
+            events: std::mem::take(&mut self.events),
+            ..*self
+        }
+    }
+}
+
+/// The events of the calling thread, handed over to [`FINISHED`] when it exits.
+struct Buffer(Events);
+
+impl Drop for Buffer {
+    fn drop(&mut self) {
+        if !self.0.events.is_empty() {
+            FINISHED.lock().expect("trace poisoned").push(self.0.take());
+        }
+    }
+}
+
+static ENABLED: AtomicBool = AtomicBool::new(false);
+
+/// The time that event timestamps count from.
+static EPOCH: OnceLock<Instant> = OnceLock::new();
+
+static NEXT_TID: AtomicU64 = AtomicU64::new(1);
+
+/// The buffers of the threads that have exited.
+static FINISHED: Mutex<Vec<Events>> = Mutex::new(Vec::new());
+
+thread_local! {
+    static BUFFER: RefCell<Buffer> = RefCell::new(Buffer(Events {
+        tid: NEXT_TID.fetch_add(1, Ordering::Relaxed),
+        name: "thread",
+        events: Vec::new(),
+    }));
+}
+
+/// Starts recording spans for the rest of the process.
+pub fn enable_tracing() {
+    EPOCH.get_or_init(Instant::now);
+    ENABLED.store(true, Ordering::Relaxed);
+}
+
+/// Returns the current time if tracing is enabled, to pass to [`span`] later.
+#[inline]
+pub(crate) fn start() -> Option<Instant> {
+    ENABLED.load(Ordering::Relaxed).then(Instant::now)
+}
+
+/// Names the calling thread in the trace, e.g. "reader".
+pub(crate) fn name_thread(name: &'static str) {
+    if ENABLED.load(Ordering::Relaxed) {
+        let _ = BUFFER.try_with(|buffer| buffer.borrow_mut().0.name = name);
+    }
+}
+
+/// Records a span named `name` from `started` until now on the calling thread.
+///
+/// # Arguments
+/// * `name` - The stage, e.g. "parse".
+/// * `started` - The result of [`start`]; nothing is recorded if it is `None`.
+/// * `chunk` - The sequence number of the chunk the stage worked on, if any.
+/// * `bytes` - The number of bytes the stage handled, if known.
+pub(crate) fn span(
+    name: &'static str,
+    started: Option<Instant>,
+    chunk: Option<u64>,
+    bytes: Option<u64>,
+) {
+    if let Some(started) = started {
+        span_lasting(name, started, started.elapsed(), chunk, bytes);
+    }
+}
+
+/// Records a span named `name` that starts at `started` and lasts `duration`, for stages
+/// whose time is summed over many short stretches.
+///
+/// The arguments are those of [`span`]; `started` is taken as is.
+pub(crate) fn span_lasting(
+    name: &'static str,
+    started: Instant,
+    duration: Duration,
+    chunk: Option<u64>,
+    bytes: Option<u64>,
+) {
+    let epoch = *EPOCH.get().expect("tracing enabled");
+    let event = Event {
+        name,
+        start: started.saturating_duration_since(epoch).as_nanos() as u64,
+        duration: duration.as_nanos() as u64,
+        chunk,
+        bytes,
+    };
+    let _ = BUFFER.try_with(|buffer| buffer.borrow_mut().0.events.push(event));
+}
+
+/// Writes a nanosecond count as fractional microseconds, the unit of trace timestamps.
+fn micros(nanos: u64) -> String {
+    format!("{}.{:03}", nanos / 1000, nanos % 1000)
+}
+
+/// Writes every span recorded so far to `path` as Chrome trace-event JSON.
+///
+/// Takes the events of threads that have exited and of the calling thread; spans of threads
+/// that are still running are not included.
+///
+/// # Arguments
+/// * `path` - The trace file, which is created or truncated.
+pub fn write_trace(path: &Path) -> io::Result<()> {
+    let mut buffers = std::mem::take(&mut *FINISHED.lock().expect("trace poisoned"));
+    buffers.push(BUFFER.with(|buffer| buffer.borrow_mut().0.take()));
+    buffers.sort_by_key(|buffer| buffer.tid);
+
+    let pid = std::process::id();
+    let mut out = BufWriter::new(std::fs::File::create(path)?);
+    write!(out, "{{\"displayTimeUnit\":\"ms\",\"traceEvents\":[")?;
+    let mut first = true;
+    let mut separator = |out: &mut BufWriter<std::fs::File>| {
+        let comma = if first { "\n" } else { ",\n" };
+        first = false;
+        out.write_all(comma.as_bytes())
+    };
+    for buffer in buffers.iter().filter(|buffer| !buffer.events.is_empty()) {
+        separator(&mut out)?;
+        write!(
+            out,
+            "{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":{},\"tid\":{},\
+             \"args\":{{\"name\":\"{} {}\"}}}}",
+            pid, buffer.tid, buffer.name, buffer.tid
+        )?;
+        for event in &buffer.events {
+            separator(&mut out)?;
+            write!(
+                out,
+                "{{\"name\":\"{}\",\"cat\":\"nconv\",\"ph\":\"X\",\"pid\":{},\"tid\":{},\
+                 \"ts\":{},\"dur\":{},\"args\":{{",
+                event.name,
+                pid,
+                buffer.tid,
+                micros(event.start),
+                micros(event.duration)
+            )?;
+            let args = [("chunk", event.chunk), ("bytes", event.bytes)];
+            let mut args = args
+                .iter()
+                .filter_map(|(k, v)| v.map(|v| (k, v)))
+                .peekable();
+            while let Some((key, value)) = args.next() {
+                let comma = if args.peek().is_some() { "," } else { "" };
+                write!(out, "\"{}\":{}{}", key, value, comma)?;
+            }
+            write!(out, "}}}}")?;
+        }
+    }
+    writeln!(out, "\n]}}")?;
+    out.flush()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn spans_of_every_thread_end_up_in_the_trace() {
+        enable_tracing();
+        std::thread::spawn(|| {
+            name_thread("worker");
+            span("parse", start(), Some(7), Some(4096));
+        })
+        .join()
+        .unwrap();
+        span("write", start(), None, Some(10));
+
+        let path = std::env::temp_dir().join(format!("nconv-trace-{}.json", std::process::id()));
+        write_trace(&path).unwrap();
+        let text = std::fs::read_to_string(&path).unwrap();
+        std::fs::remove_file(&path).unwrap();
+        assert!(text.starts_with("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+        assert!(text.trim_end().ends_with("]}"));
+        assert!(text.contains("\"args\":{\"name\":\"worker "));
+        assert!(text.contains("\"name\":\"parse\""));
+        assert!(text.contains("\"args\":{\"chunk\":7,\"bytes\":4096}"));
+        assert!(text.contains("\"args\":{\"bytes\":10}"));
+    }
+}
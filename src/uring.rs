@@ -0,0 +1,398 @@
+//! A minimal io_uring binding for the batch file modes.
+//!
+//! Only what the file reader and writer need is covered: ring setup, buffer registration,
+//! fixed-buffer reads, plain writes, and completion reaping. Everything is built on the raw
+//! system calls so no extra dependency is needed, and [`IoUring::new`] fails cleanly on
+//! kernels (or sandboxes) without io_uring so callers can fall back to plain reads.
+use std::io;
+use std::os::unix::io::RawFd;
+use std::sync::atomic::{AtomicU32, Ordering};
+
+const IORING_OFF_SQ_RING: i64 = 0;
+const IORING_OFF_CQ_RING: i64 = 0x800_0000;
+const IORING_OFF_SQES: i64 = 0x1000_0000;
+const IORING_ENTER_GETEVENTS: u32 = 1;
+const IORING_REGISTER_BUFFERS: u32 = 0;
+const IORING_OP_READ_FIXED: u8 = 4;
+const IORING_OP_WRITE: u8 = 23;
+
+#[repr(C)]
+#[derive(Default)]
+struct SqRingOffsets {
+    head: u32,
+    tail: u32,
+    ring_mask: u32,
+    ring_entries: u32,
+    flags: u32,
+    dropped: u32,
+    array: u32,
+    resv1: u32,
+    user_addr: u64,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct CqRingOffsets {
+    head: u32,
+    tail: u32,
+    ring_mask: u32,
+    ring_entries: u32,
+    overflow: u32,
+    cqes: u32,
+    flags: u32,
+    resv1: u32,
+    user_addr: u64,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct Params {
+    sq_entries: u32,
+    cq_entries: u32,
+    flags: u32,
+    sq_thread_cpu: u32,
+    sq_thread_idle: u32,
+    features: u32,
+    wq_fd: u32,
+    resv: [u32; 3],
+    sq_off: SqRingOffsets,
+    cq_off: CqRingOffsets,
+}
+
+/// A submission queue entry.
+#[repr(C)]
+#[derive(Default, Clone, Copy)]
+pub(crate) struct Sqe {
+    opcode: u8,
+    flags: u8,
+    ioprio: u16,
+    fd: i32,
+    off: u64,
+    addr: u64,
+    len: u32,
+    op_flags: u32,
+    user_data: u64,
+    buf_index: u16,
+    personality: u16,
+    splice_fd_in: i32,
+    addr3: u64,
+    pad: u64,
+}
+
+impl Sqe {
+    /// Reads `len` bytes at file offset `off` into registered buffer `buf_index` at `buf`.
+    pub(crate) fn read_fixed(
+        fd: RawFd,
+        buf: *mut u8,
+        len: u32,
+        off: u64,
+        buf_index: u16,
+        user_data: u64,
+    ) -> Sqe {
+        Sqe {
+            opcode: IORING_OP_READ_FIXED,
+            fd,
+            off,
+            addr: buf as u64,
+            len,
+            buf_index,
+            user_data,
+            ..Sqe::default()
+        }
+    }
+
+    /// Writes `len` bytes from `buf` at file offset `off`.
+    pub(crate) fn write(fd: RawFd, buf: *const u8, len: u32, off: u64, user_data: u64) -> Sqe {
+        Sqe {
+            opcode: IORING_OP_WRITE,
+            fd,
+            off,
+            addr: buf as u64,
+            len,
+            user_data,
+            ..Sqe::default()
+        }
+    }
+}
+
+/// A completion queue entry.
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub(crate) struct Cqe {
+    pub(crate) user_data: u64,
+    pub(crate) res: i32,
+    pub(crate) flags: u32,
+}
+
+/// A memory mapping of part of the ring, unmapped on drop.
+struct RingMap {
+    ptr: *mut u8,
+    len: usize,
+}
+
+impl RingMap {
+    fn new(fd: RawFd, len: usize, offset: i64) -> io::Result<RingMap> {
+        // SAFETY: maps a ring region of a live io_uring file descriptor.
+        let ptr = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_SHARED | libc::MAP_POPULATE,
+                fd,
+                offset,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(RingMap {
+            ptr: ptr as *mut u8,
+            len,
+        })
+    }
+
+    /// Returns a pointer `offset` bytes into the mapping.
+    fn at<T>(&self, offset: u32) -> *mut T {
+        debug_assert!((offset as usize) < self.len);
+        // SAFETY: offsets come from the kernel and lie within the mapping.
+        unsafe { self.ptr.add(offset as usize) as *mut T }
+    }
+}
+
+impl Drop for RingMap {
+    fn drop(&mut self) {
+        // SAFETY: unmaps exactly the region mapped in `new`.
+        unsafe { libc::munmap(self.ptr as *mut libc::c_void, self.len) };
+    }
+}
+
+/// An io_uring instance owned by a single thread.
+pub(crate) struct IoUring {
+    fd: RawFd,
+    _sq_map: RingMap,
+    _cq_map: RingMap,
+    sqes_map: RingMap,
+    sq_tail: *const AtomicU32,
+    sq_head: *const AtomicU32,
+    sq_mask: u32,
+    sq_array: *mut u32,
+    sq_entries: u32,
+    cq_head: *const AtomicU32,
+    cq_tail: *const AtomicU32,
+    cq_mask: u32,
+    cqes: *const Cqe,
+    /// Entries pushed since the last submit.
+    pending: u32,
+}
+
+// The ring is only ever used by the thread that owns it; moving it is fine.
+unsafe impl Send for IoUring {}
+
+impl IoUring {
+    /// Creates a ring with room for at least `entries` in-flight submissions.
+    ///
+    /// # Returns
+    /// * `Ok(IoUring)` - The ring.
+    /// * `Err(io::Error)` - If the kernel does not support io_uring or refuses to set it up.
+    pub(crate) fn new(entries: u32) -> io::Result<IoUring> {
+        let mut params = Params::default();
+        // SAFETY: io_uring_setup only writes into `params`.
+        let fd = unsafe {
+            libc::syscall(
+                libc::SYS_io_uring_setup,
+                entries,
+                &mut params as *mut Params,
+            )
+        };
+        if fd < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        let fd = fd as RawFd;
+
+        let maps = (|| {
+            let sq_len =
+                params.sq_off.array as usize + params.sq_entries as usize * size_of::<u32>();
+            let cq_len =
+                params.cq_off.cqes as usize + params.cq_entries as usize * size_of::<Cqe>();
+            let sqes_len = params.sq_entries as usize * size_of::<Sqe>();
+            Ok::<_, io::Error>((
+                RingMap::new(fd, sq_len, IORING_OFF_SQ_RING)?,
+                RingMap::new(fd, cq_len, IORING_OFF_CQ_RING)?,
+                RingMap::new(fd, sqes_len, IORING_OFF_SQES)?,
+            ))
+        })();
+        let (sq_map, cq_map, sqes_map) = match maps {
+            Ok(maps) => maps,
+            Err(e) => {
+                // SAFETY: closes the descriptor returned by io_uring_setup above.
+                unsafe { libc::close(fd) };
+                return Err(e);
+            }
+        };
+
+        // SAFETY: all offsets were reported by the kernel for these mappings.
+        let sq_mask = unsafe { *sq_map.at::<u32>(params.sq_off.ring_mask) };
+        let cq_mask = unsafe { *cq_map.at::<u32>(params.cq_off.ring_mask) };
+        Ok(IoUring {
+            fd,
+            sq_tail: sq_map.at(params.sq_off.tail),
+            sq_head: sq_map.at(params.sq_off.head),
+            sq_mask,
+            sq_array: sq_map.at(params.sq_off.array),
+            sq_entries: params.sq_entries,
+            cq_head: cq_map.at(params.cq_off.head),
+            cq_tail: cq_map.at(params.cq_off.tail),
+            cq_mask,
+            cqes: cq_map.at(params.cq_off.cqes),
+            _sq_map: sq_map,
+            _cq_map: cq_map,
+            sqes_map,
+            pending: 0,
+        })
+    }
+
+    /// Registers fixed buffers for use with [`Sqe::read_fixed`].
+    ///
+    /// # Safety
+    /// The buffers must stay allocated, and must not move, for the lifetime of the ring.
+    pub(crate) unsafe fn register_buffers(&self, buffers: &[libc::iovec]) -> io::Result<()> {
+        let ret = libc::syscall(
+            libc::SYS_io_uring_register,
+            self.fd,
+            IORING_REGISTER_BUFFERS,
+            buffers.as_ptr(),
+            buffers.len() as u32,
+        );
+        if ret < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(())
+    }
+
+    /// Queues a submission without entering the kernel.
+    ///
+    /// # Returns
+    /// Whether there was room in the submission queue.
+    ///
+    /// # Safety
+    /// Any memory the entry points at must stay valid until its completion is reaped.
+    pub(crate) unsafe fn push(&mut self, sqe: Sqe) -> bool {
+        let head = (*self.sq_head).load(Ordering::Acquire);
+        let tail = (*self.sq_tail).load(Ordering::Relaxed);
+        if tail.wrapping_sub(head) == self.sq_entries {
+            return false;
+        }
+        let index = tail & self.sq_mask;
+        *self.sqes_map.at::<Sqe>(0).add(index as usize) = sqe;
+        *self.sq_array.add(index as usize) = index;
+        (*self.sq_tail).store(tail.wrapping_add(1), Ordering::Release);
+        self.pending += 1;
+        true
+    }
+
+    /// Submits all queued entries and waits until at least `wait_for` completions are ready.
+    pub(crate) fn submit_and_wait(&mut self, wait_for: u32) -> io::Result<()> {
+        let flags = if wait_for > 0 {
+            IORING_ENTER_GETEVENTS
+        } else {
+            0
+        };
+        loop {
+            // SAFETY: io_uring_enter on our own ring; no pointers are passed.
+            let ret = unsafe {
+                libc::syscall(
+                    libc::SYS_io_uring_enter,
+                    self.fd,
+                    self.pending,
+                    wait_for,
+                    flags,
+                    std::ptr::null::<libc::sigset_t>(),
+                    0usize,
+                )
+            };
+            if ret >= 0 {
+                self.pending -= (ret as u32).min(self.pending);
+                return Ok(());
+            }
+            let err = io::Error::last_os_error();
+            if err.kind() != io::ErrorKind::Interrupted {
+                return Err(err);
+            }
+        }
+    }
+
+    /// Takes the next completion, if one is ready.
+    pub(crate) fn pop(&mut self) -> Option<Cqe> {
+        // SAFETY: head and tail point into the live completion ring.
+        unsafe {
+            let head = (*self.cq_head).load(Ordering::Relaxed);
+            let tail = (*self.cq_tail).load(Ordering::Acquire);
+            if head == tail {
+                return None;
+            }
+            let cqe = *self.cqes.add((head & self.cq_mask) as usize);
+            (*self.cq_head).store(head.wrapping_add(1), Ordering::Release);
+            Some(cqe)
+        }
+    }
+}
+
+impl Drop for IoUring {
+    fn drop(&mut self) {
+        // SAFETY: closes the descriptor owned by this ring. The mappings are dropped after.
+        unsafe { libc::close(self.fd) };
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::io::Write;
+    use std::os::unix::io::AsRawFd;
+
+    #[test]
+    fn io_uring_reads_and_writes_or_is_unavailable() -> io::Result<()> {
+        let mut ring = match IoUring::new(4) {
+            Ok(ring) => ring,
+            // Not every kernel or sandbox allows io_uring; callers fall back in that case.
+            Err(_) => return Ok(()),
+        };
+
+        let path = std::env::temp_dir().join(format!("nconv-uring-{}", std::process::id()));
+        std::fs::File::create(&path)?.write_all(b"0123456789")?;
+        let file = std::fs::OpenOptions::new()
+            .read(true)
+            .write(true)
+            .open(&path)?;
+
+        let mut buf = vec![0u8; 16];
+        let iov = [libc::iovec {
+            iov_base: buf.as_mut_ptr() as *mut libc::c_void,
+            iov_len: buf.len(),
+        }];
+        unsafe {
+            ring.register_buffers(&iov)?;
+            assert!(ring.push(Sqe::read_fixed(
+                file.as_raw_fd(),
+                buf.as_mut_ptr(),
+                4,
+                3,
+                0,
+                7
+            )));
+        }
+        ring.submit_and_wait(1)?;
+        let cqe = ring.pop().expect("a completion");
+        assert_eq!((cqe.user_data, cqe.res), (7, 4));
+        assert_eq!(&buf[..4], b"3456");
+
+        unsafe { assert!(ring.push(Sqe::write(file.as_raw_fd(), b"ab".as_ptr(), 2, 10, 8))) };
+        ring.submit_and_wait(1)?;
+        assert_eq!(ring.pop().map(|c| c.res), Some(2));
+        assert!(ring.pop().is_none());
+
+        assert_eq!(std::fs::read(&path)?, b"0123456789ab");
+        std::fs::remove_file(&path)
+    }
+}